@@ -0,0 +1,43 @@
+// Microbenchmark for the zero-block check used by the full-image scan.
+// Prints the time each implementation needs per GiB of zeroed blocks.
+#include "zero_check.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static bool isZeroBlockAllOf(const void *data, size_t size) {
+    const char *bytes = static_cast<const char *>(data);
+    return std::all_of(bytes, bytes + size, [](char c) { return c == 0; });
+}
+
+static double secondsPerGiB(bool (*check)(const void *, size_t), const std::vector<char> &buffer,
+                            size_t blockSize, int passes) {
+    size_t zeroBlocks = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; ++pass) {
+        for (size_t offset = 0; offset + blockSize <= buffer.size(); offset += blockSize) {
+            zeroBlocks += check(buffer.data() + offset, blockSize);
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (zeroBlocks != passes * (buffer.size() / blockSize)) {
+        fprintf(stderr, "zero check returned a wrong result\n");
+        exit(EXIT_FAILURE);
+    }
+    double gib = static_cast<double>(buffer.size()) * passes / (1 << 30);
+    return elapsed.count() / gib;
+}
+
+int main(int argc, char *argv[]) {
+    size_t blockSize = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4096;
+    int passes = argc > 2 ? atoi(argv[2]) : 16;
+    std::vector<char> buffer(64 << 20, 0);
+
+    printf("block size %zu, %d x %zu MiB of zero blocks\n", blockSize, passes, buffer.size() >> 20);
+    printf("%-16s %10.4f s/GiB\n", "std::all_of", secondsPerGiB(isZeroBlockAllOf, buffer, blockSize, passes));
+    printf("%-16s %10.4f s/GiB\n", "scalar", secondsPerGiB(isZeroBlockScalar, buffer, blockSize, passes));
+    printf("%-16s %10.4f s/GiB\n", zeroCheckImplementation(), secondsPerGiB(isZeroBlock, buffer, blockSize, passes));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,184 @@
+#include "bitmap.h"
+#include <algorithm>
+#include <cstring>
+#include "cpu_dispatch.h"
+
+static inline uint64_t lowMask(size_t length) {
+    return length >= 64 ? ~uint64_t(0) : (uint64_t(1) << length) - 1;
+}
+
+// Without -mpopcnt __builtin_popcountll is a libgcc call; the popcnt
+// kernel gets the instruction on CPUs that have it.
+static size_t countWordsScalar(const uint64_t *words, size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        total += __builtin_popcountll(words[i]);
+    }
+    return total;
+}
+
+#ifdef HAVE_X86_DISPATCH
+__attribute__((target("popcnt")))
+static size_t countWordsPopcnt(const uint64_t *words, size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        total += __builtin_popcountll(words[i]);
+    }
+    return total;
+}
+#endif
+
+typedef size_t (*CountWordsFunction)(const uint64_t *, size_t);
+
+static const CpuKernel<CountWordsFunction> countWordsKernels[] = {
+#ifdef HAVE_X86_DISPATCH
+    {CPU_POPCNT, countWordsPopcnt, "popcnt"},
+#endif
+    {CPU_PORTABLE, countWordsScalar, "scalar"},
+};
+
+static const CountWordsFunction countWords = selectCpuKernel(countWordsKernels).function;
+
+Bitmap::Bitmap(size_t bitCount)
+    : bitCount(bitCount), words((bitCount + 63) / 64, 0) {}
+
+void Bitmap::setRange(size_t begin, size_t end) {
+    end = std::min(end, bitCount);
+    while (begin < end) {
+        size_t shift = begin % 64;
+        size_t length = std::min<size_t>(64 - shift, end - begin);
+        words[begin / 64] |= lowMask(length) << shift;
+        begin += length;
+    }
+}
+
+size_t Bitmap::count() const {
+    return countWords(words.data(), words.size());
+}
+
+// The partial words at either end are masked; the whole words between
+// them are counted in one pass.
+size_t Bitmap::count(size_t begin, size_t end) const {
+    end = std::min(end, bitCount);
+    if (begin >= end) {
+        return 0;
+    }
+    size_t first = begin / 64;
+    size_t last = (end - 1) / 64;
+    uint64_t edges[2] = {words[first] & (~uint64_t(0) << (begin % 64)), 0};
+    if (first == last) {
+        edges[0] &= lowMask(end - last * 64);
+        return countWords(edges, 1);
+    }
+    edges[1] = words[last] & lowMask(end - last * 64);
+    return countWords(edges, 2) + countWords(words.data() + first + 1, last - first - 1);
+}
+
+size_t Bitmap::findNextSet(size_t from) const {
+    if (from >= bitCount) {
+        return npos;
+    }
+    size_t index = from / 64;
+    uint64_t word = words[index] & (~uint64_t(0) << (from % 64));
+    while (word == 0) {
+        if (++index == words.size()) {
+            return npos;
+        }
+        word = words[index];
+    }
+    size_t bit = index * 64 + __builtin_ctzll(word);
+    return bit < bitCount ? bit : npos;
+}
+
+size_t Bitmap::findNextClear(size_t from) const {
+    if (from >= bitCount) {
+        return npos;
+    }
+    size_t index = from / 64;
+    uint64_t word = ~words[index] & (~uint64_t(0) << (from % 64));
+    while (word == 0) {
+        if (++index == words.size()) {
+            return npos;
+        }
+        word = ~words[index];
+    }
+    size_t bit = index * 64 + __builtin_ctzll(word);
+    return bit < bitCount ? bit : npos;
+}
+
+// Returns bits [begin, begin + length) in the low bits; length <= 64.
+uint64_t Bitmap::extract(size_t begin, size_t length) const {
+    size_t index = begin / 64;
+    size_t shift = begin % 64;
+    uint64_t value = words[index] >> shift;
+    if (shift != 0 && shift + length > 64) {
+        value |= words[index + 1] << (64 - shift);
+    }
+    return value & lowMask(length);
+}
+
+template <typename Combine>
+void Bitmap::combineRange(Bitmap &dst, size_t dstBegin, size_t srcBegin, size_t length, Combine combine) const {
+    length = std::min({length, bitCount - std::min(srcBegin, bitCount), dst.bitCount - std::min(dstBegin, dst.bitCount)});
+    while (length > 0) {
+        size_t shift = dstBegin % 64;
+        size_t chunk = std::min<size_t>(64 - shift, length);
+        uint64_t mask = lowMask(chunk) << shift;
+        uint64_t &word = dst.words[dstBegin / 64];
+        word = combine(word, extract(srcBegin, chunk) << shift, mask);
+        dstBegin += chunk;
+        srcBegin += chunk;
+        length -= chunk;
+    }
+}
+
+void Bitmap::copyRangeTo(Bitmap &dst, size_t dstBegin, size_t srcBegin, size_t length) const {
+    combineRange(dst, dstBegin, srcBegin, length,
+                 [](uint64_t word, uint64_t bits, uint64_t mask) { return (word & ~mask) | bits; });
+}
+
+void Bitmap::orRangeInto(Bitmap &dst, size_t dstBegin, size_t srcBegin, size_t length) const {
+    combineRange(dst, dstBegin, srcBegin, length,
+                 [](uint64_t word, uint64_t bits, uint64_t) { return word | bits; });
+}
+
+void Bitmap::merge(const Bitmap &other) {
+    size_t common = std::min(words.size(), other.words.size());
+    for (size_t i = 0; i < common; ++i) {
+        words[i] |= other.words[i];
+    }
+    clearTail();
+}
+
+void Bitmap::loadBytes(const void *bytes, size_t byteCount) {
+    std::fill(words.begin(), words.end(), 0);
+    const unsigned char *source = static_cast<const unsigned char *>(bytes);
+    byteCount = std::min(byteCount, words.size() * sizeof(uint64_t));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(words.data(), source, byteCount);
+#else
+    for (size_t i = 0; i < byteCount; ++i) {
+        words[i / 8] |= uint64_t(source[i]) << (8 * (i % 8));
+    }
+#endif
+    clearTail();
+}
+
+void Bitmap::storeBytes(void *bytes, size_t byteCount) const {
+    unsigned char *target = static_cast<unsigned char *>(bytes);
+    size_t available = std::min(byteCount, words.size() * sizeof(uint64_t));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(target, words.data(), available);
+#else
+    for (size_t i = 0; i < available; ++i) {
+        target[i] = static_cast<unsigned char>(words[i / 8] >> (8 * (i % 8)));
+    }
+#endif
+    memset(target + available, 0, byteCount - available);
+}
+
+void Bitmap::clearTail() {
+    if (bitCount % 64 != 0) {
+        words.back() &= lowMask(bitCount % 64);
+    }
+}
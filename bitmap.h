@@ -0,0 +1,69 @@
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Fixed-size bitmap stored in 64-bit words. Bit i of the on-disk ext2
+// layout (bit i % 8 of byte i / 8) maps to bit i here, so group bitmaps
+// can be loaded and stored directly.
+class Bitmap {
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    Bitmap() = default;
+    explicit Bitmap(size_t bitCount);
+
+    size_t size() const {
+        return bitCount;
+    }
+
+    bool test(size_t bit) const {
+        return (words[bit / 64] >> (bit % 64)) & 1;
+    }
+
+    void set(size_t bit) {
+        words[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+
+    void clear(size_t bit) {
+        words[bit / 64] &= ~(uint64_t(1) << (bit % 64));
+    }
+
+    // Sets bits [begin, end).
+    void setRange(size_t begin, size_t end);
+
+    // Number of set bits, over the whole bitmap or in [begin, end).
+    size_t count() const;
+    size_t count(size_t begin, size_t end) const;
+
+    // First set/clear bit at or after from, or npos if there is none.
+    size_t findNextSet(size_t from) const;
+    size_t findNextClear(size_t from) const;
+
+    // Copies (or ORs) bits [srcBegin, srcBegin + length) of this bitmap into
+    // dst starting at dstBegin. Neither offset has to be word aligned.
+    void copyRangeTo(Bitmap &dst, size_t dstBegin, size_t srcBegin, size_t length) const;
+    void orRangeInto(Bitmap &dst, size_t dstBegin, size_t srcBegin, size_t length) const;
+
+    // ORs a bitmap of the same size into this one.
+    void merge(const Bitmap &other);
+
+    // Converts from/to the on-disk byte layout. Bits beyond size() are
+    // ignored on load and written as zero on store.
+    void loadBytes(const void *bytes, size_t byteCount);
+    void storeBytes(void *bytes, size_t byteCount) const;
+
+private:
+    size_t bitCount = 0;
+    std::vector<uint64_t> words;
+
+    uint64_t extract(size_t begin, size_t length) const;
+    void clearTail();
+
+    template <typename Combine>
+    void combineRange(Bitmap &dst, size_t dstBegin, size_t srcBegin, size_t length, Combine combine) const;
+};
+
+#endif // !BITMAP_H
@@ -0,0 +1,30 @@
+#include "block_ownership.h"
+#include <algorithm>
+
+BlockOwnershipIndex::BlockOwnershipIndex(uint32_t blockCount)
+    : blockCount(blockCount), entries(new std::atomic<uint32_t>[blockCount]) {
+    for (uint32_t block = 0; block < blockCount; ++block) {
+        entries[block].store(0, std::memory_order_relaxed);
+    }
+}
+
+bool BlockOwnershipIndex::claim(uint32_t block, uint32_t inode) {
+    if (block >= blockCount) {
+        return true;
+    }
+    uint32_t expected = 0;
+    if (entries[block].compare_exchange_strong(expected, inode, std::memory_order_relaxed) || expected == inode) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(crossLinksMutex);
+    crossLinks.push_back({block, expected, inode});
+    return false;
+}
+
+std::vector<BlockOwnershipIndex::CrossLink> BlockOwnershipIndex::getCrossLinks() const {
+    std::lock_guard<std::mutex> lock(crossLinksMutex);
+    std::vector<CrossLink> sorted = crossLinks;
+    std::sort(sorted.begin(), sorted.end(), [](const CrossLink &a, const CrossLink &b) { return a.block < b.block; });
+    return sorted;
+}
@@ -0,0 +1,43 @@
+#ifndef BLOCK_OWNERSHIP_H
+#define BLOCK_OWNERSHIP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Reverse map from block number to the inode that points to it, filled in
+// during the inode walk so "who owns block B" is a constant-time lookup.
+// Claims may come from several threads at once.
+class BlockOwnershipIndex {
+public:
+    struct CrossLink {
+        uint32_t block;
+        uint32_t firstInode;
+        uint32_t secondInode;
+    };
+
+    explicit BlockOwnershipIndex(uint32_t blockCount);
+
+    // Records inode as the owner of block. If a different inode already
+    // holds it, keeps the first one, records a cross-link and returns false.
+    // Blocks outside the filesystem are ignored.
+    bool claim(uint32_t block, uint32_t inode);
+
+    bool isOwned(uint32_t block) const {
+        return block < blockCount && entries[block].load(std::memory_order_relaxed) != 0;
+    }
+
+    std::vector<CrossLink> getCrossLinks() const;
+
+private:
+    // One owning inode per block, 0 when the block is not owned.
+    uint32_t blockCount;
+    std::unique_ptr<std::atomic<uint32_t>[]> entries;
+    mutable std::mutex crossLinksMutex;
+    std::vector<CrossLink> crossLinks;
+};
+
+#endif // !BLOCK_OWNERSHIP_H
@@ -0,0 +1,223 @@
+#include "block_scanner.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+
+#ifdef HAVE_IO_URING
+
+// Minimal io_uring instance driven through the raw syscalls, so the scanner
+// does not depend on liburing being installed.
+struct BlockScanner::Ring {
+    int fd = -1;
+    void *sqRing = MAP_FAILED;
+    void *cqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    unsigned *sqTail = nullptr;
+    unsigned *sqMask = nullptr;
+    unsigned *sqArray = nullptr;
+    unsigned *cqHead = nullptr;
+    unsigned *cqTail = nullptr;
+    unsigned *cqMask = nullptr;
+    io_uring_cqe *cqes = nullptr;
+
+    ~Ring() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if (fd != -1) close(fd);
+    }
+
+    bool setup(unsigned entries) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        fd = syscall(__NR_io_uring_setup, entries, &params);
+        if (fd < 0) {
+            fd = -1;
+            return false;
+        }
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMap) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) return false;
+        cqRing = singleMap ? sqRing
+                           : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) return false;
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe *>(
+            mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) return false;
+
+        char *sq = static_cast<char *>(sqRing);
+        char *cq = static_cast<char *>(cqRing);
+        sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    void queueRead(int fileFd, void *buf, unsigned length, off_t offset, uint64_t userData) {
+        unsigned tail = *sqTail;
+        unsigned index = tail & *sqMask;
+        io_uring_sqe *sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fileFd;
+        sqe->addr = reinterpret_cast<uint64_t>(buf);
+        sqe->len = length;
+        sqe->off = offset;
+        sqe->user_data = userData;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    void submitAndWait(unsigned toSubmit) {
+        while (syscall(__NR_io_uring_enter, fd, toSubmit, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0) {
+            if (errno != EINTR) {
+                throw std::runtime_error("io_uring_enter failed");
+            }
+            toSubmit = 0;
+        }
+    }
+};
+
+#else
+
+struct BlockScanner::Ring {
+    bool setup(unsigned) { return false; }
+};
+
+#endif
+
+BlockScanner::BlockScanner(int fd, uint32_t blockSize, unsigned queueDepth)
+    : fd(fd), blockSize(blockSize), queueDepth(queueDepth) {
+    blocksPerChunk = std::max<uint32_t>(1, BLOCK_SCAN_CHUNK_SIZE / blockSize);
+    ring.reset(new Ring());
+    if (!ring->setup(queueDepth)) {
+        ring.reset();
+    }
+}
+
+BlockScanner::~BlockScanner() = default;
+
+void BlockScanner::scan(uint32_t firstBlock, uint32_t endBlock, const ChunkCallback &callback) {
+    if (firstBlock >= endBlock) {
+        return;
+    }
+    // One chunk buffer per read that can be in flight, and never more than
+    // the range has chunks; kept for later scans by the same thread.
+    uint32_t chunks = (endBlock - firstBlock - 1) / blocksPerChunk + 1;
+    size_t slots = ring ? std::min<uint32_t>(queueDepth, chunks) : 1;
+    size_t chunkBytes = static_cast<size_t>(blocksPerChunk) * blockSize;
+    if (buffers.size() < slots * chunkBytes) {
+        buffers.resize(slots * chunkBytes);
+    }
+    if (ring) {
+        scanWithRing(firstBlock, endBlock, callback);
+    } else {
+        scanWithPread(firstBlock, endBlock, callback);
+    }
+}
+
+// Finishes a chunk of count bytes of which done are already in buf; the
+// part past the end of the image is zero-filled.
+void BlockScanner::readChunk(char *buf, size_t done, size_t count, off_t offset) const {
+    while (done < count) {
+        ssize_t got = pread(fd, buf + done, count - done, offset + done);
+        if (got <= 0) {
+            memset(buf + done, 0, count - done);
+            return;
+        }
+        done += got;
+    }
+}
+
+void BlockScanner::scanWithPread(uint32_t firstBlock, uint32_t endBlock, const ChunkCallback &callback) {
+    // Stepping by count cannot wrap past endBlock near the 32-bit limit.
+    for (uint32_t block = firstBlock, count; block < endBlock; block += count) {
+        count = std::min(blocksPerChunk, endBlock - block);
+        readChunk(buffers.data(), 0, static_cast<size_t>(count) * blockSize, static_cast<off_t>(block) * blockSize);
+        callback(block, buffers.data(), count);
+    }
+}
+
+#ifdef HAVE_IO_URING
+
+void BlockScanner::scanWithRing(uint32_t firstBlock, uint32_t endBlock, const ChunkCallback &callback) {
+    struct Slot {
+        uint32_t block;
+        uint32_t count;
+    };
+    size_t chunkBytes = static_cast<size_t>(blocksPerChunk) * blockSize;
+    unsigned slotCount = buffers.size() / chunkBytes;
+    std::vector<Slot> slots(slotCount);
+    std::vector<unsigned> freeSlots;
+    for (unsigned i = slotCount; i > 0; --i) {
+        freeSlots.push_back(i - 1);
+    }
+
+    uint32_t nextBlock = firstBlock;
+    unsigned inFlight = 0;
+    while (nextBlock < endBlock || inFlight > 0) {
+        unsigned toSubmit = 0;
+        while (!freeSlots.empty() && nextBlock < endBlock) {
+            unsigned slot = freeSlots.back();
+            freeSlots.pop_back();
+            slots[slot] = {nextBlock, std::min(blocksPerChunk, endBlock - nextBlock)};
+            ring->queueRead(fd, buffers.data() + slot * chunkBytes, static_cast<size_t>(slots[slot].count) * blockSize,
+                            static_cast<off_t>(nextBlock) * blockSize, slot);
+            nextBlock += slots[slot].count;
+            ++toSubmit;
+        }
+        inFlight += toSubmit;
+        ring->submitAndWait(toSubmit);
+
+        unsigned head = *ring->cqHead;
+        unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe &cqe = ring->cqes[head & *ring->cqMask];
+            unsigned slot = static_cast<unsigned>(cqe.user_data);
+            char *buf = buffers.data() + slot * chunkBytes;
+            size_t bytes = static_cast<size_t>(slots[slot].count) * blockSize;
+
+            // Errors (e.g. a kernel without IORING_OP_READ) and short reads
+            // are finished synchronously.
+            readChunk(buf, cqe.res > 0 ? cqe.res : 0, bytes, static_cast<off_t>(slots[slot].block) * blockSize);
+            callback(slots[slot].block, buf, slots[slot].count);
+
+            freeSlots.push_back(slot);
+            --inFlight;
+        }
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    }
+}
+
+#else
+
+void BlockScanner::scanWithRing(uint32_t firstBlock, uint32_t endBlock, const ChunkCallback &callback) {
+    scanWithPread(firstBlock, endBlock, callback);
+}
+
+#endif
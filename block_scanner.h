@@ -0,0 +1,48 @@
+#ifndef BLOCK_SCANNER_H
+#define BLOCK_SCANNER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Bytes requested per read by the full-image block scan.
+#define BLOCK_SCAN_CHUNK_SIZE (1 << 20)
+// Default number of chunk reads kept in flight with io_uring.
+#define BLOCK_SCAN_QUEUE_DEPTH 32
+
+// Reads a range of blocks in large chunks. With io_uring available, up to
+// queueDepth chunk reads are kept in flight; otherwise chunks are read
+// synchronously with pread.
+class BlockScanner {
+public:
+    // Receives blockCount consecutive blocks starting at firstBlock. Chunks
+    // can complete out of order. Blocks past the end of the image read as zero.
+    using ChunkCallback = std::function<void(uint32_t firstBlock, const char *data, uint32_t blockCount)>;
+
+    BlockScanner(int fd, uint32_t blockSize, unsigned queueDepth);
+    ~BlockScanner();
+
+    void scan(uint32_t firstBlock, uint32_t endBlock, const ChunkCallback &callback);
+
+    bool usesIoUring() const {
+        return ring != nullptr;
+    }
+
+private:
+    struct Ring;
+
+    int fd;
+    uint32_t blockSize;
+    uint32_t blocksPerChunk;
+    unsigned queueDepth;
+    std::unique_ptr<Ring> ring;
+    std::vector<char> buffers;
+
+    void scanWithRing(uint32_t firstBlock, uint32_t endBlock, const ChunkCallback &callback);
+    void scanWithPread(uint32_t firstBlock, uint32_t endBlock, const ChunkCallback &callback);
+    void readChunk(char *buf, size_t done, size_t count, off_t offset) const;
+};
+
+#endif // !BLOCK_SCANNER_H
@@ -0,0 +1,28 @@
+#include "buffer_pool.h"
+#include <cstdlib>
+#include <new>
+
+BufferPool::BufferPool(size_t bufferSize, size_t alignment)
+    : size(bufferSize), alignment(alignment) {}
+
+BufferPool::~BufferPool() {
+    for (char *memory : allBuffers) {
+        free(memory);
+    }
+}
+
+BufferPool::Buffer BufferPool::acquire() {
+    if (freeBuffers.empty()) {
+        // aligned_alloc wants the size to be a multiple of the alignment.
+        size_t rounded = (size + alignment - 1) / alignment * alignment;
+        char *memory = static_cast<char *>(aligned_alloc(alignment, rounded));
+        if (memory == nullptr) {
+            throw std::bad_alloc();
+        }
+        allBuffers.push_back(memory);
+        return Buffer(this, memory);
+    }
+    char *memory = freeBuffers.back();
+    freeBuffers.pop_back();
+    return Buffer(this, memory);
+}
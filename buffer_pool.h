@@ -0,0 +1,68 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+#include <vector>
+
+// Recycles equally sized, aligned buffers. Memory is only released when
+// the pool is destroyed. A pool is not thread-safe; give each thread its own.
+class BufferPool {
+public:
+    // Hands a buffer back to its pool when destroyed.
+    class Buffer {
+    public:
+        Buffer() = default;
+        Buffer(Buffer &&other) noexcept
+            : pool(other.pool), memory(other.memory) {
+            other.memory = nullptr;
+        }
+        Buffer &operator=(Buffer &&other) noexcept {
+            if (this != &other) {
+                release();
+                pool = other.pool;
+                memory = other.memory;
+                other.memory = nullptr;
+            }
+            return *this;
+        }
+        Buffer(const Buffer &) = delete;
+        Buffer &operator=(const Buffer &) = delete;
+        ~Buffer() {
+            release();
+        }
+
+        char *data() const {
+            return memory;
+        }
+
+    private:
+        friend class BufferPool;
+        Buffer(BufferPool *pool, char *memory)
+            : pool(pool), memory(memory) {}
+
+        void release() {
+            if (memory != nullptr) {
+                pool->freeBuffers.push_back(memory);
+                memory = nullptr;
+            }
+        }
+
+        BufferPool *pool = nullptr;
+        char *memory = nullptr;
+    };
+
+    explicit BufferPool(size_t bufferSize, size_t alignment = 4096);
+    ~BufferPool();
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    Buffer acquire();
+
+private:
+    size_t size;
+    size_t alignment;
+    std::vector<char *> freeBuffers;
+    std::vector<char *> allBuffers;
+};
+
+#endif // !BUFFER_POOL_H
@@ -0,0 +1,67 @@
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+#include <stddef.h>
+
+// Hot loops come in several kernels, each built for one instruction set
+// with __attribute__((target(...))), so the binary needs no -m flags and
+// still runs on any x86-64 (or non-x86) CPU. Each caller lists its kernels
+// best first, ending with a portable one, and selectCpuKernel picks the
+// first the running CPU supports once, when the program starts.
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_DISPATCH 1
+#endif
+
+enum CpuFeature {
+    CPU_PORTABLE,
+    CPU_SSE2,
+    CPU_POPCNT,
+    CPU_AVX2,
+    CPU_AVX512F,
+    CPU_AVX512BW,
+};
+
+// __builtin_cpu_supports only takes string literals, hence the switch.
+inline bool cpuSupports(CpuFeature feature) {
+#ifdef HAVE_X86_DISPATCH
+    __builtin_cpu_init();
+    switch (feature) {
+    case CPU_PORTABLE:
+        return true;
+    case CPU_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case CPU_POPCNT:
+        return __builtin_cpu_supports("popcnt");
+    case CPU_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case CPU_AVX512F:
+        return __builtin_cpu_supports("avx512f");
+    case CPU_AVX512BW:
+        return __builtin_cpu_supports("avx512bw");
+    }
+    return false;
+#else
+    return feature == CPU_PORTABLE;
+#endif
+}
+
+template <typename Function>
+struct CpuKernel {
+    CpuFeature feature;
+    Function function;
+    const char *name;
+};
+
+// First kernel whose feature the CPU has; the last one must be portable.
+template <typename Function, size_t Count>
+const CpuKernel<Function> &selectCpuKernel(const CpuKernel<Function> (&kernels)[Count]) {
+    for (size_t i = 0; i + 1 < Count; ++i) {
+        if (cpuSupports(kernels[i].feature)) {
+            return kernels[i];
+        }
+    }
+    return kernels[Count - 1];
+}
+
+#endif // !CPU_DISPATCH_H
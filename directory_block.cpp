@@ -0,0 +1,65 @@
+#include "directory_block.h"
+#include "ext2fs.h"
+#include <cstring>
+
+// Fixed part of an entry: inode, rec_len, name_len and file_type.
+#define DIR_ENTRY_HEADER_SIZE 8
+
+// Highest file_type value ext2 defines (symbolic link).
+#define DIR_ENTRY_MAX_FILE_TYPE 7
+
+// Entries are read with memcpy since a corrupt chain can leave them at any
+// offset.
+static ext2_dir_entry readEntry(const char *data, size_t offset) {
+    ext2_dir_entry entry;
+    memcpy(&entry, data + offset, DIR_ENTRY_HEADER_SIZE);
+    return entry;
+}
+
+bool isDirectoryBlock(const char *data, size_t blockSize, uint32_t inodeCount) {
+    size_t offset = 0;
+    bool live = false;
+    while (offset < blockSize) {
+        if (offset + DIR_ENTRY_HEADER_SIZE > blockSize) {
+            return false;
+        }
+        ext2_dir_entry entry = readEntry(data, offset);
+        if (entry.length < DIR_ENTRY_HEADER_SIZE || entry.length % 4 != 0 || entry.length > blockSize - offset) {
+            return false;
+        }
+        if (entry.inode > inodeCount || entry.file_type > DIR_ENTRY_MAX_FILE_TYPE) {
+            return false;
+        }
+        if (entry.inode != 0) {
+            if (entry.name_length == 0 || DIR_ENTRY_HEADER_SIZE + entry.name_length > entry.length) {
+                return false;
+            }
+            live = true;
+        }
+        offset += entry.length;
+    }
+    return live;
+}
+
+// Reads the "." and ".." entries that open the first block of a directory;
+// false if the block does not start with them.
+static bool readDotEntries(const char *data, size_t blockSize, ext2_dir_entry &self, ext2_dir_entry &parent) {
+    self = readEntry(data, 0);
+    if (self.inode == 0 || self.name_length != 1 || data[DIR_ENTRY_HEADER_SIZE] != '.' ||
+        static_cast<size_t>(self.length) + DIR_ENTRY_HEADER_SIZE + 2 > blockSize) {
+        return false;
+    }
+    parent = readEntry(data, self.length);
+    const char *parentName = data + self.length + DIR_ENTRY_HEADER_SIZE;
+    return parent.inode != 0 && parent.name_length == 2 && parentName[0] == '.' && parentName[1] == '.';
+}
+
+uint32_t directorySelfInode(const char *data, size_t blockSize) {
+    ext2_dir_entry self, parent;
+    return readDotEntries(data, blockSize, self, parent) ? self.inode : 0;
+}
+
+uint32_t directoryParentInode(const char *data, size_t blockSize) {
+    ext2_dir_entry self, parent;
+    return readDotEntries(data, blockSize, self, parent) ? parent.inode : 0;
+}
@@ -0,0 +1,23 @@
+#ifndef DIRECTORY_BLOCK_H
+#define DIRECTORY_BLOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// True if the block parses as a complete ext2_dir_entry chain: every record
+// 4-byte aligned, at least 8 bytes and long enough for its name, names
+// non-empty, inode numbers at most inodeCount, and the record lengths
+// adding up to exactly blockSize. Blocks without a live entry are rejected
+// since nothing could be recovered from them.
+bool isDirectoryBlock(const char *data, size_t blockSize, uint32_t inodeCount);
+
+// Inode of the "." entry if the block starts with "." followed by "..",
+// i.e. it is the first block of that directory; 0 otherwise. The block must
+// already have passed isDirectoryBlock.
+uint32_t directorySelfInode(const char *data, size_t blockSize);
+
+// Inode of the ".." entry of such a first block, i.e. the directory it
+// hangs under; 0 if directorySelfInode would return 0.
+uint32_t directoryParentInode(const char *data, size_t blockSize);
+
+#endif // !DIRECTORY_BLOCK_H
@@ -10,6 +10,9 @@
 #ifndef EXT2_INODE_SIZE
 #define EXT2_INODE_SIZE 256
 #endif
+/* Revision 0 images have no inode_size field; their inodes are this big */
+#define EXT2_GOOD_OLD_REV 0
+#define EXT2_GOOD_OLD_INODE_SIZE 128
 #define EXT2_NUM_DIRECT_BLOCKS 12
 #define EXT2_MAX_NAME_LENGTH 255
 
@@ -19,9 +22,10 @@
 #define EXT2_UNLOG(v) (1UL << (10UL + (v)))
 
 /* inode mode bits for file type */
-// regular file and directory
+// regular file, directory and symbolic link
 #define EXT2_I_FTYPE   0x8000
 #define EXT2_I_DTYPE   0x4000
+#define EXT2_I_LTYPE   0xA000
 
 /* dir entry file types */
 // regular file and directory
@@ -107,6 +111,9 @@ struct ext2_inode {
     uint32_t single_indirect;
     uint32_t double_indirect;
     uint32_t triple_indirect;
+    uint32_t generation; /* File version, used by NFS */
+    uint32_t file_acl; /* Block holding extended attributes */
+    uint32_t size_high; /* Most significant 32-bits of file size for regular files in rev. 1 */
     /* Some other stuff that we don't care about too much */
 };
 
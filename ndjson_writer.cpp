@@ -0,0 +1,57 @@
+#include "ndjson_writer.h"
+#include <charconv>
+
+void NdjsonWriter::beginRecord(std::string_view type) {
+    output.write("{\"record\":");
+    writeString(type);
+}
+
+void NdjsonWriter::field(std::string_view key, std::string_view value) {
+    writeKey(key);
+    writeString(value);
+}
+
+void NdjsonWriter::field(std::string_view key, uint64_t value) {
+    writeKey(key);
+    char digits[20];
+    char *end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+    output.write(std::string_view(digits, end - digits));
+}
+
+void NdjsonWriter::endRecord() {
+    output.write("}\n");
+}
+
+void NdjsonWriter::writeKey(std::string_view key) {
+    output.put(',');
+    writeString(key);
+    output.put(':');
+}
+
+void NdjsonWriter::writeString(std::string_view text) {
+    static const char hex[] = "0123456789abcdef";
+    output.put('"');
+    size_t start = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = text[i];
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+            continue;
+        }
+        output.write(text.substr(start, i - start));
+        start = i + 1;
+        output.put('\\');
+        switch (c) {
+        case '"': output.put('"'); break;
+        case '\\': output.put('\\'); break;
+        case '\n': output.put('n'); break;
+        case '\t': output.put('t'); break;
+        case '\r': output.put('r'); break;
+        default:
+            output.write("u00");
+            output.put(hex[c >> 4]);
+            output.put(hex[c & 0xF]);
+        }
+    }
+    output.write(text.substr(start));
+    output.put('"');
+}
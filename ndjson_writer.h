@@ -0,0 +1,42 @@
+#ifndef NDJSON_WRITER_H
+#define NDJSON_WRITER_H
+
+#include <stdint.h>
+#include <string_view>
+#include "output_writer.h"
+
+// Writes newline-delimited JSON objects, one per record, through an
+// OutputWriter. Records are built field by field so nothing is buffered
+// beyond the writer itself:
+//
+//     json.beginRecord("entry");
+//     json.field("inode", 12);
+//     json.endRecord();
+//
+// produces {"record":"entry","inode":12}.
+class NdjsonWriter {
+public:
+    explicit NdjsonWriter(OutputWriter &output)
+        : output(output) {}
+
+    void beginRecord(std::string_view type);
+    void field(std::string_view key, std::string_view value);
+    void field(std::string_view key, uint64_t value);
+    void endRecord();
+
+    // Pushes the finished records out so readers see them right away.
+    void flush() {
+        output.flush();
+    }
+
+private:
+    OutputWriter &output;
+
+    void writeKey(std::string_view key);
+    // Quotes and escapes a string. Control bytes and bytes from 0x80 up
+    // become \u00XX, so any byte string (ext2 names need not be UTF-8)
+    // gives valid ASCII JSON and decoding as Latin-1 restores the bytes.
+    void writeString(std::string_view text);
+};
+
+#endif // !NDJSON_WRITER_H
@@ -0,0 +1,56 @@
+#include "output_writer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+
+OutputWriter::OutputWriter(int fd, size_t capacity)
+    : fd(fd), buffer(std::max<size_t>(capacity, 1)) {}
+
+OutputWriter::~OutputWriter() {
+    try {
+        flush();
+    } catch (const std::exception &) {
+    }
+}
+
+void OutputWriter::write(std::string_view text) {
+    while (!text.empty()) {
+        if (used == buffer.size()) {
+            flush();
+        }
+        size_t count = std::min(text.size(), buffer.size() - used);
+        memcpy(buffer.data() + used, text.data(), count);
+        used += count;
+        text.remove_prefix(count);
+    }
+}
+
+void OutputWriter::repeat(char c, size_t count) {
+    while (count > 0) {
+        if (used == buffer.size()) {
+            flush();
+        }
+        size_t chunk = std::min(count, buffer.size() - used);
+        memset(buffer.data() + used, c, chunk);
+        used += chunk;
+        count -= chunk;
+    }
+}
+
+void OutputWriter::flush() {
+    size_t done = 0;
+    while (done < used) {
+        ssize_t written = ::write(fd, buffer.data() + done, used - done);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            used = 0;
+            throw std::runtime_error("Failed to write output");
+        }
+        done += written;
+    }
+    used = 0;
+}
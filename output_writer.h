@@ -0,0 +1,43 @@
+#ifndef OUTPUT_WRITER_H
+#define OUTPUT_WRITER_H
+
+#include <stddef.h>
+#include <string_view>
+#include <vector>
+
+// Default size of the OutputWriter buffer.
+#define OUTPUT_WRITER_BUFFER_SIZE (1 << 16)
+
+// Collects output in one reusable buffer and hands it to write(2) in large
+// chunks. Nothing reaches fd before the buffer fills or flush() is called,
+// so output written to the same fd through stdio must be flushed first.
+class OutputWriter {
+public:
+    explicit OutputWriter(int fd, size_t capacity = OUTPUT_WRITER_BUFFER_SIZE);
+    // Flushes what is left, ignoring errors; call flush() to see them.
+    ~OutputWriter();
+    OutputWriter(const OutputWriter &) = delete;
+    OutputWriter &operator=(const OutputWriter &) = delete;
+
+    void write(std::string_view text);
+
+    void put(char c) {
+        if (used == buffer.size()) {
+            flush();
+        }
+        buffer[used++] = c;
+    }
+
+    // Appends count copies of c with one memset per buffer's worth.
+    void repeat(char c, size_t count);
+
+    // Writes out everything buffered. Throws std::runtime_error on failure.
+    void flush();
+
+private:
+    int fd;
+    std::vector<char> buffer;
+    size_t used = 0;
+};
+
+#endif // !OUTPUT_WRITER_H
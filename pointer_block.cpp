@@ -0,0 +1,124 @@
+#include "pointer_block.h"
+#include "cpu_dispatch.h"
+
+#ifdef HAVE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+// At most one in this many adjacent pointer pairs may go backwards.
+#define POINTER_BLOCK_DESCENT_RATIO 8
+
+static void summarizeScalar(const uint32_t *entries, size_t begin, size_t count, uint32_t firstBlock, uint32_t endBlock,
+                            PointerBlockSummary &summary) {
+    for (size_t i = begin; i < count; ++i) {
+        uint32_t entry = entries[i];
+        if (entry == 0) {
+            continue;
+        }
+        ++summary.nonZero;
+        if (entry < firstBlock || entry >= endBlock) {
+            ++summary.outOfRange;
+        }
+        if (i + 1 < count && entries[i + 1] != 0 && entries[i + 1] <= entry) {
+            ++summary.descending;
+        }
+    }
+}
+
+static PointerBlockSummary summarizePointerBlockScalar(const uint32_t *entries, size_t count, uint32_t firstBlock, uint32_t endBlock) {
+    PointerBlockSummary summary = {0, 0, 0};
+    summarizeScalar(entries, 0, count, firstBlock, endBlock, summary);
+    return summary;
+}
+
+#ifdef HAVE_X86_DISPATCH
+
+// The kernels compare entries [i, i + lanes) with [i + 1, i + lanes + 1),
+// so the vector loop stops one lane group early and the scalar tail
+// finishes the block, including its last pair.
+
+__attribute__((target("avx2,popcnt")))
+static PointerBlockSummary summarizePointerBlockAvx2(const uint32_t *entries, size_t count, uint32_t firstBlock, uint32_t endBlock) {
+    PointerBlockSummary summary = {0, 0, 0};
+    // x is in [firstBlock, endBlock) iff x - firstBlock < endBlock - firstBlock
+    // unsigned; AVX2 only has signed compares, hence the sign flips.
+    const __m256i sign = _mm256_set1_epi32(INT32_MIN);
+    const __m256i base = _mm256_set1_epi32(firstBlock);
+    const __m256i limit = _mm256_xor_si256(_mm256_set1_epi32(endBlock - firstBlock), sign);
+    const __m256i zero = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 9 <= count; i += 8) {
+        __m256i current = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(entries + i));
+        __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(entries + i + 1));
+        __m256i currentZero = _mm256_cmpeq_epi32(current, zero);
+        __m256i nextZero = _mm256_cmpeq_epi32(next, zero);
+        __m256i offset = _mm256_xor_si256(_mm256_sub_epi32(current, base), sign);
+        __m256i inRange = _mm256_cmpgt_epi32(limit, offset);
+        __m256i ascending = _mm256_cmpgt_epi32(_mm256_xor_si256(next, sign), _mm256_xor_si256(current, sign));
+
+        unsigned zeroMask = _mm256_movemask_ps(_mm256_castsi256_ps(currentZero));
+        unsigned nextZeroMask = _mm256_movemask_ps(_mm256_castsi256_ps(nextZero));
+        unsigned inRangeMask = _mm256_movemask_ps(_mm256_castsi256_ps(inRange));
+        unsigned ascendingMask = _mm256_movemask_ps(_mm256_castsi256_ps(ascending));
+        unsigned nonZeroMask = ~zeroMask & 0xFF;
+
+        summary.nonZero += __builtin_popcount(nonZeroMask);
+        summary.outOfRange += __builtin_popcount(nonZeroMask & ~inRangeMask);
+        summary.descending += __builtin_popcount(nonZeroMask & ~nextZeroMask & ~ascendingMask & 0xFF);
+    }
+    summarizeScalar(entries, i, count, firstBlock, endBlock, summary);
+    return summary;
+}
+
+__attribute__((target("avx512f,popcnt")))
+static PointerBlockSummary summarizePointerBlockAvx512(const uint32_t *entries, size_t count, uint32_t firstBlock, uint32_t endBlock) {
+    PointerBlockSummary summary = {0, 0, 0};
+    const __m512i base = _mm512_set1_epi32(firstBlock);
+    const __m512i span = _mm512_set1_epi32(endBlock - firstBlock);
+
+    size_t i = 0;
+    for (; i + 17 <= count; i += 16) {
+        __m512i current = _mm512_loadu_si512(entries + i);
+        __m512i next = _mm512_loadu_si512(entries + i + 1);
+        __mmask16 nonZero = _mm512_test_epi32_mask(current, current);
+        __mmask16 nextNonZero = _mm512_test_epi32_mask(next, next);
+        __mmask16 inRange = _mm512_cmp_epu32_mask(_mm512_sub_epi32(current, base), span, _MM_CMPINT_LT);
+        __mmask16 descending = _mm512_mask_cmp_epu32_mask(nonZero & nextNonZero, next, current, _MM_CMPINT_LE);
+
+        summary.nonZero += __builtin_popcount(nonZero);
+        summary.outOfRange += __builtin_popcount(nonZero & ~inRange & 0xFFFF);
+        summary.descending += __builtin_popcount(descending);
+    }
+    summarizeScalar(entries, i, count, firstBlock, endBlock, summary);
+    return summary;
+}
+
+#endif
+
+typedef PointerBlockSummary (*SummarizeFunction)(const uint32_t *, size_t, uint32_t, uint32_t);
+
+static const CpuKernel<SummarizeFunction> summarizeKernels[] = {
+#ifdef HAVE_X86_DISPATCH
+    {CPU_AVX512F, summarizePointerBlockAvx512, "avx512"},
+    {CPU_AVX2, summarizePointerBlockAvx2, "avx2"},
+#endif
+    {CPU_PORTABLE, summarizePointerBlockScalar, "scalar"},
+};
+
+static const CpuKernel<SummarizeFunction> &summarizeKernel = selectCpuKernel(summarizeKernels);
+
+PointerBlockSummary summarizePointerBlock(const uint32_t *entries, size_t count, uint32_t firstBlock, uint32_t endBlock) {
+    return summarizeKernel.function(entries, count, firstBlock, endBlock);
+}
+
+bool looksLikePointerBlock(const uint32_t *entries, size_t count, uint32_t firstBlock, uint32_t endBlock) {
+    // Real pointers are never below the first data block, so a quick look
+    // at the first entry rejects most data blocks before the full pass.
+    if (count == 0 || (entries[0] != 0 && (entries[0] < firstBlock || entries[0] >= endBlock))) {
+        return false;
+    }
+    PointerBlockSummary summary = summarizePointerBlock(entries, count, firstBlock, endBlock);
+    return summary.nonZero > 0 && summary.outOfRange == 0 &&
+           summary.descending * POINTER_BLOCK_DESCENT_RATIO <= summary.nonZero;
+}
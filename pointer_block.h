@@ -0,0 +1,22 @@
+#ifndef POINTER_BLOCK_H
+#define POINTER_BLOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Shape of a block read as an array of 32-bit block pointers.
+struct PointerBlockSummary {
+    uint32_t nonZero;    // entries that are not zero
+    uint32_t outOfRange; // non-zero entries outside [firstBlock, endBlock)
+    uint32_t descending; // adjacent non-zero pairs whose second entry is not larger
+};
+
+// Summarizes count entries against the range [firstBlock, endBlock). Uses
+// AVX-512 or AVX2 when the CPU has it.
+PointerBlockSummary summarizePointerBlock(const uint32_t *entries, size_t count, uint32_t firstBlock, uint32_t endBlock);
+
+// True if the entries could be an indirect block: at least one pointer,
+// every pointer inside the filesystem and the pointers mostly ascending.
+bool looksLikePointerBlock(const uint32_t *entries, size_t count, uint32_t firstBlock, uint32_t endBlock);
+
+#endif // !POINTER_BLOCK_H
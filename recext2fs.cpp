@@ -1,16 +1,98 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+#include <stdexcept>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "ext2fs.h"
 #include "identifier.h"
 #include "ext2fs_print.h"
+#include "block_scanner.h"
+#include "zero_check.h"
+#include "bitmap.h"
+#include "thread_pool.h"
+#include "buffer_pool.h"
+#include "block_ownership.h"
+#include "signature_scanner.h"
+#include "pointer_block.h"
+#include "directory_block.h"
+#include "output_writer.h"
+#include "ndjson_writer.h"
 #include <algorithm>
 #include <stack>
 #include <map>
+#include <array>
+#include <tuple>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string_view>
+#include <type_traits>
+#include <thread>
 
 #define EXT2_BLOCK_SIZE(sb) (1024 << (sb).log_block_size)
+// log_block_size of the largest block size ext2 allows (64 KiB).
+#define EXT2_MAX_LOG_BLOCK_SIZE 6
+
+// Bytes of inode table read per request by FileSystemReader::scanInodeGroup.
+#define INODE_SCAN_CHUNK_SIZE (1 << 20)
+
+// Inodes at most this many slots apart in one table are fetched with a
+// single read by FileSystemReader::readInodeBatch.
+#define INODE_BATCH_GAP 64
+
+// Indirect blocks of one tree level at most this many blocks apart are
+// fetched with a single read by BlockBitmapRecovery::walkIndirectTrees,
+// up to INDIRECT_BATCH_SIZE bytes per read.
+#define INDIRECT_BATCH_GAP 8
+#define INDIRECT_BATCH_SIZE (1 << 20)
+
+// Directories nested deeper than this are listed but not entered.
+#define MAX_TRAVERSAL_DEPTH 4096
+
+// Largest --queue-depth accepted. Each worker holds one BLOCK_SCAN_CHUNK_SIZE
+// buffer per queue slot, so this keeps it at 256 MiB; io_uring itself
+// refuses rings of more than 4096 entries.
+#define MAX_SCAN_QUEUE_DEPTH 256
+
+// Full 64-bit size; only regular files keep the upper half in size_high.
+static uint64_t inodeFileSize(const ext2_inode &inode) {
+    uint64_t size = inode.size;
+    if ((inode.mode & 0xF000) == EXT2_I_FTYPE) {
+        size |= static_cast<uint64_t>(inode.size_high) << 32;
+    }
+    return size;
+}
+
+// Calls body(std::integral_constant<uint32_t, N>()) with N the block size
+// for the specialized sizes (1K, 2K, 4K and 64K), so loops over a block
+// get a constant trip count; other sizes get N = 0 and use the runtime size.
+template <typename Body>
+static void dispatchBlockSize(uint32_t blockSize, Body &&body) {
+    switch (blockSize) {
+    case 1024:
+        body(std::integral_constant<uint32_t, 1024>());
+        break;
+    case 2048:
+        body(std::integral_constant<uint32_t, 2048>());
+        break;
+    case 4096:
+        body(std::integral_constant<uint32_t, 4096>());
+        break;
+    case 65536:
+        body(std::integral_constant<uint32_t, 65536>());
+        break;
+    default:
+        body(std::integral_constant<uint32_t, 0>());
+        break;
+    }
+}
 
 class FileSystemReader {
 public:
@@ -20,10 +102,18 @@ public:
         if (fd == -1) {
             throw std::runtime_error("Failed to open image file");
         }
+        mapImage();
         fetchSuperblock();
+        validateSuperblock();
+        blockSize = EXT2_BLOCK_SIZE(superBlock);
+        fetchInodeSize();
+        fetchGroupDescriptors();
     }
 
     ~FileSystemReader() {
+        if (mappedImage != nullptr) {
+            munmap(mappedImage, mappedSize);
+        }
         close(fd);
     }
 
@@ -31,243 +121,1480 @@ public:
         return superBlock;
     }
 
-    void readInode(int inodeIndex, ext2_inode *inode) {
-        off_t inodeTableStart = calculateInodeTableStart((inodeIndex - 1) / superBlock.inodes_per_group);
-        off_t inodeOffset = ((inodeIndex - 1) % superBlock.inodes_per_group) * EXT2_INODE_SIZE;
-        lseek(fd, inodeTableStart + inodeOffset, SEEK_SET);
-        read(fd, inode, sizeof(ext2_inode));
+    uint32_t getBlockSize() const {
+        return blockSize;
+    }
+
+    // Blocks taken by one group's inode table.
+    uint32_t getInodeTableBlocks() const {
+        return (static_cast<uint64_t>(superBlock.inodes_per_group) * inodeSize + blockSize - 1) / blockSize;
+    }
+
+    uint32_t getBlockGroupCount() const {
+        return static_cast<uint32_t>(groupDescriptors.size());
+    }
+
+    // Byte offset of a block; 64-bit so images past 4 GiB are addressed
+    // correctly.
+    off_t blockOffset(uint32_t block) const {
+        return static_cast<off_t>(block) * blockSize;
+    }
+
+    const ext2_block_group_descriptor &getGroupDescriptor(uint32_t group) const {
+        return groupDescriptors[group];
+    }
+
+    // True when the image is mapped and views below are zero-copy.
+    bool isMapped() const {
+        return mappedImage != nullptr;
+    }
+
+    // True when a view of this block needs no scratch buffer; blocks past
+    // the end of a truncated image are never mapped.
+    bool isBlockMapped(uint32_t block) const {
+        return isRangeMapped(blockSize, blockOffset(block));
+    }
+
+    void readInode(uint32_t inodeIndex, ext2_inode *inode) const {
+        preadData(inode, sizeof(ext2_inode), calculateInodeOffset(inodeIndex));
+    }
+
+    void writeInode(uint32_t inodeIndex, const ext2_inode &inode) {
+        pwriteData(&inode, sizeof(ext2_inode), calculateInodeOffset(inodeIndex));
+    }
+
+    // Read-only views: point into the mapped image when possible, otherwise
+    // the data is pread into scratch and scratch is returned.
+    const char *dataView(size_t count, off_t offset, void *scratch) const {
+        if (isRangeMapped(count, offset)) {
+            return mappedImage + offset;
+        }
+        preadData(scratch, count, offset);
+        return static_cast<const char *>(scratch);
+    }
+
+    const char *blockView(uint32_t block, char *scratch) const {
+        return dataView(blockSize, blockOffset(block), scratch);
+    }
+
+    // Streams one group's inode table in large sequential chunks and calls
+    // visit(inodeIndex, inode) once for every inode with a non-zero link count.
+    // Safe to call for different groups from different threads.
+    template <typename Visitor>
+    void scanInodeGroup(uint32_t group, Visitor &&visit) const {
+        // The common sizes get a constant stride; anything else is walked
+        // with the runtime one.
+        switch (inodeSize) {
+        case 128:
+            scanInodeGroupWithStride<128>(group, visit);
+            break;
+        case 256:
+            scanInodeGroupWithStride<256>(group, visit);
+            break;
+        default:
+            scanInodeGroupWithStride<0>(group, visit);
+            break;
+        }
+    }
+
+    // Calls visit(inodeIndex, inode) for each of the sorted inodeIndexes.
+    // Inodes close together in the same table are fetched with one read,
+    // so a sorted batch touches the tables almost sequentially.
+    template <typename Visitor>
+    void readInodeBatch(const std::vector<uint32_t> &inodeIndexes, Visitor &&visit) const {
+        std::vector<char> scratch;
+        for (size_t first = 0; first < inodeIndexes.size();) {
+            uint32_t group = (inodeIndexes[first] - 1) / superBlock.inodes_per_group;
+            size_t last = first;
+            while (last + 1 < inodeIndexes.size() && (inodeIndexes[last + 1] - 1) / superBlock.inodes_per_group == group &&
+                   inodeIndexes[last + 1] - inodeIndexes[last] <= INODE_BATCH_GAP &&
+                   static_cast<size_t>(inodeIndexes[last + 1] - inodeIndexes[first] + 1) * inodeSize <= INODE_SCAN_CHUNK_SIZE) {
+                ++last;
+            }
+
+            size_t count = inodeIndexes[last] - inodeIndexes[first] + 1;
+            scratch.resize(count * inodeSize);
+            const char *data = dataView(scratch.size(), calculateInodeOffset(inodeIndexes[first]), scratch.data());
+            for (size_t i = first; i <= last; ++i) {
+                size_t position = inodeIndexes[i] - inodeIndexes[first];
+                visit(inodeIndexes[i], *reinterpret_cast<const ext2_inode *>(data + position * inodeSize));
+            }
+            first = last + 1;
+        }
+    }
+
+    void setScanQueueDepth(unsigned queueDepth) {
+        scanQueueDepth = queueDepth;
+    }
+
+    // Reads blocks [firstBlock, endBlock) in large chunks: through io_uring
+    // when available, else straight from the mapping, else with pread.
+    void scanBlocks(uint32_t firstBlock, uint32_t endBlock, const BlockScanner::ChunkCallback &callback) const {
+        ThreadBuffers &buffers = threadBuffers();
+        if (!buffers.scanner) {
+            buffers.scanner.reset(new BlockScanner(fd, blockSize, scanQueueDepth));
+        }
+        BlockScanner &scanner = *buffers.scanner;
+        if (scanner.usesIoUring() || !isMapped()) {
+            scanner.scan(firstBlock, endBlock, callback);
+            return;
+        }
+
+        const uint32_t blocksPerChunk = std::max<uint32_t>(1, BLOCK_SCAN_CHUNK_SIZE / blockSize);
+        std::vector<char> scratch;
+        for (uint32_t block = firstBlock, count; block < endBlock; block += count) {
+            count = std::min(blocksPerChunk, endBlock - block);
+            size_t bytes = static_cast<size_t>(count) * blockSize;
+            off_t offset = blockOffset(block);
+            if (static_cast<size_t>(offset) + bytes > mappedSize) {
+                scratch.assign(bytes, 0);
+            }
+            callback(block, dataView(bytes, offset, scratch.data()), count);
+        }
     }
 
+    // Block-sized, page-aligned buffer from the calling thread's pool; goes
+    // back to the pool when the handle is destroyed.
+    BufferPool::Buffer acquireBlockBuffer() const {
+        return threadBuffers().blockPool.acquire();
+    }
+
+    // Linux moves at most about 2 GiB per call, so large transfers are
+    // looped. Whatever cannot be read (past the end of a truncated image,
+    // or after an I/O error) reads as zero, so reused scratch buffers never
+    // hand back stale data.
     void preadData(void *buf, size_t count, off_t offset) const {
-        pread(fd, buf, count, offset);
+        char *bytes = static_cast<char *>(buf);
+        while (count > 0) {
+            ssize_t done = pread(fd, bytes, count, offset);
+            if (done <= 0) {
+                if (done < 0 && errno == EINTR) {
+                    continue;
+                }
+                memset(bytes, 0, count);
+                return;
+            }
+            bytes += done;
+            count -= done;
+            offset += done;
+        }
     }
 
     void pwriteData(const void *buf, size_t count, off_t offset) {
-        pwrite(fd, buf, count, offset);
+        const char *bytes = static_cast<const char *>(buf);
+        while (count > 0) {
+            ssize_t done = pwrite(fd, bytes, count, offset);
+            if (done <= 0) {
+                if (done < 0 && errno == EINTR) {
+                    continue;
+                }
+                return;
+            }
+            bytes += done;
+            count -= done;
+            offset += done;
+        }
+    }
+
+    // Replaces the free/used counters of the superblock and every group
+    // descriptor, then writes the superblock and the whole descriptor table
+    // back with one write each.
+    void writeCounters(const std::vector<ext2_block_group_descriptor> &descriptors, uint32_t freeBlockCount, uint32_t freeInodeCount) {
+        superBlock.free_block_count = freeBlockCount;
+        superBlock.free_inode_count = freeInodeCount;
+        groupDescriptors = descriptors;
+        pwriteData(&superBlock, sizeof(ext2_super_block), 1024);
+        pwriteData(groupDescriptors.data(), groupDescriptors.size() * sizeof(ext2_block_group_descriptor),
+                   blockOffset(superBlock.first_data_block + 1));
     }
 
 private:
     int fd;
     std::string imagePath;
     ext2_super_block superBlock;
+    uint32_t blockSize;
+    // Stride of the inode tables: 128 bytes on revision 0 images, the
+    // superblock's inode_size otherwise.
+    uint32_t inodeSize;
+    unsigned scanQueueDepth = BLOCK_SCAN_QUEUE_DEPTH;
+    std::vector<ext2_block_group_descriptor> groupDescriptors;
+    char *mappedImage = nullptr;
+    size_t mappedSize = 0;
+
+    // Buffers reused across calls by one thread. Each thread that touches
+    // the reader gets its own set, created on first use.
+    struct ThreadBuffers {
+        explicit ThreadBuffers(uint32_t blockSize)
+            : blockPool(blockSize) {}
+
+        BufferPool blockPool;
+        std::unique_ptr<BlockScanner> scanner;
+    };
+
+    const uint64_t readerId = nextReaderId++;
+    mutable std::mutex threadBuffersMutex;
+    mutable std::vector<std::unique_ptr<ThreadBuffers>> allThreadBuffers;
+    static std::atomic<uint64_t> nextReaderId;
+
+    ThreadBuffers &threadBuffers() const {
+        // Cached per thread; the id guards against a reader reusing the
+        // address of a destroyed one.
+        thread_local uint64_t cachedReaderId = 0;
+        thread_local ThreadBuffers *cachedBuffers = nullptr;
+        if (cachedReaderId != readerId) {
+            std::lock_guard<std::mutex> lock(threadBuffersMutex);
+            allThreadBuffers.emplace_back(new ThreadBuffers(blockSize));
+            cachedBuffers = allThreadBuffers.back().get();
+            cachedReaderId = readerId;
+        }
+        return *cachedBuffers;
+    }
+
+    // Maps the image read-only; writes still go through pwrite, which the
+    // shared mapping observes. Images that cannot be mapped use pread.
+    void mapImage() {
+        struct stat st;
+        if (fstat(fd, &st) == -1 || st.st_size <= 0) {
+            return;
+        }
+        void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            return;
+        }
+        madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+        mappedImage = static_cast<char *>(mapping);
+        mappedSize = st.st_size;
+    }
+
+    bool isRangeMapped(size_t count, off_t offset) const {
+        return mappedImage != nullptr && offset >= 0 && static_cast<size_t>(offset) + count <= mappedSize;
+    }
 
     void fetchSuperblock() {
-        lseek(fd, 1024, SEEK_SET);
-        read(fd, &superBlock, sizeof(ext2_super_block));
+        preadData(&superBlock, sizeof(ext2_super_block), 1024);
+    }
+
+    // Rejects geometry the readers below would index or size by without
+    // further checks: the descriptor table has to cover every inode and the
+    // first data block has to lie inside the filesystem.
+    void validateSuperblock() {
+        if (superBlock.log_block_size > EXT2_MAX_LOG_BLOCK_SIZE) {
+            throw std::runtime_error("Invalid superblock block size");
+        }
+        if (superBlock.block_count == 0 || superBlock.inode_count == 0 ||
+            superBlock.first_data_block >= superBlock.block_count) {
+            throw std::runtime_error("Invalid superblock block or inode count");
+        }
+        if (superBlock.blocks_per_group == 0 || superBlock.inodes_per_group == 0) {
+            throw std::runtime_error("Invalid superblock group geometry");
+        }
+        uint64_t blockGroupCount = (static_cast<uint64_t>(superBlock.block_count) + superBlock.blocks_per_group - 1) /
+                                   superBlock.blocks_per_group;
+        if (superBlock.inode_count > blockGroupCount * superBlock.inodes_per_group) {
+            throw std::runtime_error("Invalid superblock group geometry");
+        }
+    }
+
+    void fetchInodeSize() {
+        inodeSize = superBlock.rev_level == EXT2_GOOD_OLD_REV ? EXT2_GOOD_OLD_INODE_SIZE : superBlock.inode_size;
+        if (inodeSize < EXT2_GOOD_OLD_INODE_SIZE || inodeSize > blockSize || (inodeSize & (inodeSize - 1)) != 0) {
+            throw std::runtime_error("Invalid superblock inode size");
+        }
     }
 
-    off_t calculateInodeTableStart(int blockGroup) const {
-        ext2_block_group_descriptor bgd;
-        pread(fd, &bgd, sizeof(bgd), 1024 + EXT2_SUPER_BLOCK_SIZE + blockGroup * sizeof(bgd));
-        return static_cast<off_t>(bgd.inode_table * EXT2_BLOCK_SIZE(superBlock));
+    // Loads the whole descriptor table once; it starts in the block after
+    // the superblock. Every recovery pass shares this copy.
+    void fetchGroupDescriptors() {
+        uint32_t blockGroupCount = (static_cast<uint64_t>(superBlock.block_count) + superBlock.blocks_per_group - 1) /
+                                   superBlock.blocks_per_group;
+        groupDescriptors.resize(blockGroupCount);
+        preadData(groupDescriptors.data(), groupDescriptors.size() * sizeof(ext2_block_group_descriptor),
+                  blockOffset(superBlock.first_data_block + 1));
+
+        uint64_t inodeTableBlocks = getInodeTableBlocks();
+        for (const auto &bgd : groupDescriptors) {
+            if (bgd.block_bitmap >= superBlock.block_count || bgd.inode_bitmap >= superBlock.block_count ||
+                bgd.inode_table + inodeTableBlocks > superBlock.block_count) {
+                throw std::runtime_error("Block group descriptor points outside the filesystem");
+            }
+        }
+    }
+
+    // Body of scanInodeGroup; InodeSize is the table stride, or 0 to use
+    // the runtime inodeSize.
+    template <uint32_t InodeSize, typename Visitor>
+    void scanInodeGroupWithStride(uint32_t group, Visitor &visit) const {
+        const uint32_t stride = InodeSize != 0 ? InodeSize : inodeSize;
+        uint64_t firstInode = static_cast<uint64_t>(group) * superBlock.inodes_per_group;
+        if (firstInode >= superBlock.inode_count) {
+            return;
+        }
+        uint32_t groupInodes = std::min<uint64_t>(superBlock.inodes_per_group, superBlock.inode_count - firstInode);
+        off_t tableStart = calculateInodeTableStart(group);
+
+        const uint32_t inodesPerChunk = std::max<uint32_t>(1, INODE_SCAN_CHUNK_SIZE / stride);
+        std::vector<char> chunk(static_cast<size_t>(std::min(inodesPerChunk, groupInodes)) * stride);
+
+        for (uint32_t done = 0; done < groupInodes; done += inodesPerChunk) {
+            uint32_t count = std::min(inodesPerChunk, groupInodes - done);
+            const char *data = dataView(static_cast<size_t>(count) * stride,
+                                        tableStart + static_cast<off_t>(done) * stride, chunk.data());
+            for (uint32_t i = 0; i < count; ++i) {
+                const ext2_inode &inode = *reinterpret_cast<const ext2_inode *>(data + static_cast<size_t>(i) * stride);
+                if (inode.link_count > 0) {
+                    visit(static_cast<uint32_t>(firstInode + done + i + 1), inode);
+                }
+            }
+        }
+    }
+
+    off_t calculateInodeOffset(uint32_t inodeIndex) const {
+        off_t inodeTableStart = calculateInodeTableStart((inodeIndex - 1) / superBlock.inodes_per_group);
+        return inodeTableStart + static_cast<off_t>((inodeIndex - 1) % superBlock.inodes_per_group) * inodeSize;
+    }
+
+    off_t calculateInodeTableStart(uint32_t blockGroup) const {
+        return blockOffset(groupDescriptors[blockGroup].inode_table);
     }
 };
 
+std::atomic<uint64_t> FileSystemReader::nextReaderId{1};
+
 class InodeBitmapRecovery {
 public:
     InodeBitmapRecovery(FileSystemReader &fsReader, const std::vector<uint8_t> &dataIdentifier)
-        : fsReader(fsReader), dataIdentifier(dataIdentifier), superBlock(fsReader.getSuperblock()) {}
+        : fsReader(fsReader), dataIdentifier(dataIdentifier), superBlock(fsReader.getSuperblock()),
+          aggregatedInodeBitmap(superBlock.inode_count),
+          usedInodeCounts(fsReader.getBlockGroupCount(), 0), previousUsedInodeCounts(fsReader.getBlockGroupCount(), 0),
+          usedDirsCounts(fsReader.getBlockGroupCount(), 0) {
+        aggregatedInodeBitmap.setRange(0, 11);
+    }
+
+    // Gives every extra worker its own partial bitmap; worker 0 writes to
+    // the aggregated one.
+    void prepareWorkers(unsigned workerCount) {
+        workerBitmaps.assign(workerCount - 1, Bitmap(superBlock.inode_count));
+    }
+
+    // Called by the shared inode scan for every inode in use. Different
+    // workers must be scanning different groups.
+    void visitInode(unsigned worker, uint32_t inodeIndex, const ext2_inode &inode) {
+        bitmapFor(worker).set(inodeIndex - 1);
+        if ((inode.mode & 0xF000) == EXT2_I_DTYPE) {
+            ++usedDirsCounts[(inodeIndex - 1) / superBlock.inodes_per_group];
+        }
+    }
+
+    void recoverInodeBitmaps(ThreadPool &pool) {
+        for (const Bitmap &partial : workerBitmaps) {
+            aggregatedInodeBitmap.merge(partial);
+        }
+        workerBitmaps.clear();
+        updateInodeBitmaps(aggregatedInodeBitmap, pool);
+    }
+
+    // Per-group counts of set bits in the repaired inode bitmaps.
+    const std::vector<uint32_t> &getUsedInodeCounts() const {
+        return usedInodeCounts;
+    }
 
-    void recoverInodeBitmaps() {
-        int totalInodeBitmapSize = (superBlock.inode_count + 7) / 8;
-        std::vector<char> aggregatedInodeBitmap(totalInodeBitmapSize, 0);
-        aggregateInodeBitmap(aggregatedInodeBitmap);
-        updateInodeBitmaps(aggregatedInodeBitmap);
+    // Per-group counts of set bits in the inode bitmaps as found on disk.
+    const std::vector<uint32_t> &getPreviousUsedInodeCounts() const {
+        return previousUsedInodeCounts;
+    }
+
+    // Per-group directory counts gathered during the inode scan.
+    const std::vector<uint32_t> &getUsedDirsCounts() const {
+        return usedDirsCounts;
     }
 
 private:
     FileSystemReader &fsReader;
     const std::vector<uint8_t> &dataIdentifier;
     const ext2_super_block &superBlock;
+    Bitmap aggregatedInodeBitmap;
+    std::vector<Bitmap> workerBitmaps;
+    std::vector<uint32_t> usedInodeCounts;
+    std::vector<uint32_t> previousUsedInodeCounts;
+    std::vector<uint32_t> usedDirsCounts;
+
+    Bitmap &bitmapFor(unsigned worker) {
+        return worker == 0 ? aggregatedInodeBitmap : workerBitmaps[worker - 1];
+    }
 
-    void aggregateInodeBitmap(std::vector<char> &aggregatedInodeBitmap) {
-        for (int i = 0; i < 11; ++i) {
-            aggregatedInodeBitmap[i / 8] |= (1 << (i % 8));
+    void updateInodeBitmaps(const Bitmap &aggregatedInodeBitmap, ThreadPool &pool) {
+        pool.parallelFor(fsReader.getBlockGroupCount(), [&](size_t group, unsigned) {
+            const ext2_block_group_descriptor &bgd = fsReader.getGroupDescriptor(group);
+            std::vector<char> inodeBitmap((superBlock.inodes_per_group + 7) / 8);
+
+            fsReader.preadData(inodeBitmap.data(), inodeBitmap.size(), fsReader.blockOffset(bgd.inode_bitmap));
+
+            correctInodeBitmap(group, inodeBitmap, aggregatedInodeBitmap);
+
+            fsReader.pwriteData(inodeBitmap.data(), inodeBitmap.size(), fsReader.blockOffset(bgd.inode_bitmap));
+        });
+    }
+
+    void correctInodeBitmap(uint32_t group, std::vector<char> &inodeBitmap, const Bitmap &aggregatedInodeBitmap) {
+        uint64_t startInode = static_cast<uint64_t>(group) * superBlock.inodes_per_group;
+        if (startInode >= superBlock.inode_count) {
+            return;
         }
 
-        ext2_inode inode;
-        for (int i = 1; i <= superBlock.inode_count; ++i) {
-            fsReader.readInode(i, &inode);
-            if (inode.link_count > 0) {
-                aggregatedInodeBitmap[(i - 1) / 8] |= (1 << ((i - 1) % 8));
+        Bitmap groupBitmap(superBlock.inodes_per_group);
+        groupBitmap.loadBytes(inodeBitmap.data(), inodeBitmap.size());
+        uint32_t groupInodes = std::min<uint64_t>(superBlock.inodes_per_group, superBlock.inode_count - startInode);
+        previousUsedInodeCounts[group] = groupBitmap.count(0, groupInodes);
+        aggregatedInodeBitmap.copyRangeTo(groupBitmap, 0, startInode, superBlock.inodes_per_group);
+        groupBitmap.storeBytes(inodeBitmap.data(), inodeBitmap.size());
+        usedInodeCounts[group] = groupBitmap.count(0, groupInodes);
+    }
+};
+
+class BlockBitmapRecovery {
+public:
+    BlockBitmapRecovery(FileSystemReader &fsReader, const std::vector<uint8_t> &dataIdentifier, BlockOwnershipIndex &ownership)
+        : fsReader(fsReader), dataIdentifier(dataIdentifier), superBlock(fsReader.getSuperblock()), ownership(ownership),
+          aggregatedBitmap(superBlock.block_count - superBlock.first_data_block),
+          usedBlockCounts(fsReader.getBlockGroupCount(), 0), previousUsedBlockCounts(fsReader.getBlockGroupCount(), 0) {
+        dispatchBlockSize(fsReader.getBlockSize(), [this](auto size) {
+            indirectWalker = &BlockBitmapRecovery::walkIndirectBlock<decltype(size)::value>;
+        });
+    }
+
+    // Gives every extra worker its own partial bitmap; worker 0 writes to
+    // the aggregated one.
+    void prepareWorkers(unsigned workerCount) {
+        workerBitmaps.assign(workerCount - 1, Bitmap(aggregatedBitmap.size()));
+        workerPending.assign(workerCount, {});
+        workerScratch.assign(workerCount, {});
+        workerAnomalies.assign(workerCount, {});
+    }
+
+    // Called by the shared inode scan for every inode in use. Indirect
+    // blocks are only queued here; walkIndirectTrees reads them.
+    void visitInode(unsigned worker, uint32_t inodeIndex, const ext2_inode &inode) {
+        updateAggregatedBitmap(worker, inodeIndex, inode);
+    }
+
+    // Walks the indirect trees queued by the inode scan one level at a
+    // time: the level's blocks from every inode are sorted by position,
+    // blocks close together are read with one request, and the pointers
+    // found make up the next level. The reads sweep the image in order
+    // instead of seeking once per pointer block.
+    void walkIndirectTrees(ThreadPool &pool) {
+        const uint32_t blockSize = fsReader.getBlockSize();
+        const uint32_t blocksPerBatch = std::max<uint32_t>(1, INDIRECT_BATCH_SIZE / blockSize);
+        std::vector<PendingIndirect> level = takePending();
+        std::vector<std::pair<size_t, size_t>> batches;
+        // Each indirect block is read once, however many pointers lead to
+        // it, so shared or looping blocks in a corrupt tree are not rescanned.
+        Bitmap walked(superBlock.block_count);
+        while (!level.empty()) {
+            std::sort(level.begin(), level.end(),
+                      [](const PendingIndirect &a, const PendingIndirect &b) { return a.block < b.block; });
+            level.erase(std::remove_if(level.begin(), level.end(), [&](const PendingIndirect &pending) {
+                            if (walked.test(pending.block)) {
+                                return true;
+                            }
+                            walked.set(pending.block);
+                            return false;
+                        }),
+                        level.end());
+            batches.clear();
+            for (size_t first = 0; first < level.size();) {
+                size_t last = first;
+                while (last + 1 < level.size() && level[last + 1].block - level[last].block <= INDIRECT_BATCH_GAP &&
+                       level[last + 1].block - level[first].block < blocksPerBatch) {
+                    ++last;
+                }
+                batches.emplace_back(first, last);
+                first = last + 1;
             }
+
+            pool.parallelFor(batches.size(), [&](size_t batch, unsigned worker) {
+                const auto [first, last] = batches[batch];
+                uint32_t firstBlock = level[first].block;
+                std::vector<char> &scratch = workerScratch[worker];
+                scratch.resize(static_cast<size_t>(level[last].block - firstBlock + 1) * blockSize);
+                const char *data = fsReader.dataView(scratch.size(), fsReader.blockOffset(firstBlock), scratch.data());
+                for (size_t i = first; i <= last; ++i) {
+                    const char *block = data + static_cast<size_t>(level[i].block - firstBlock) * blockSize;
+                    (this->*indirectWalker)(worker, level[i], reinterpret_cast<const uint32_t *>(block));
+                }
+            });
+            level = takePending();
         }
+        workerScratch.clear();
     }
 
-    void updateInodeBitmaps(const std::vector<char> &aggregatedInodeBitmap) {
-        int blockGroupCount = (superBlock.block_count + superBlock.blocks_per_group - 1) / superBlock.blocks_per_group;
-        std::vector<char> inodeBitmap((superBlock.inodes_per_group + 7) / 8);
-
-        for (int group = 0; group < blockGroupCount; ++group) {
-            ext2_block_group_descriptor bgd;
-            fsReader.preadData(&bgd, sizeof(bgd), 1024 + EXT2_SUPER_BLOCK_SIZE + group * sizeof(bgd));
+    // Per-group counts of set bits in the repaired block bitmaps.
+    const std::vector<uint32_t> &getUsedBlockCounts() const {
+        return usedBlockCounts;
+    }
 
-            fsReader.preadData(inodeBitmap.data(), inodeBitmap.size(), bgd.inode_bitmap * EXT2_BLOCK_SIZE(superBlock));
+    // A pointer outside [first_data_block, block_count), found in the inode
+    // itself (parentBlock 0) or in one of its indirect blocks. Such pointers
+    // are neither marked, claimed nor followed.
+    struct PointerAnomaly {
+        uint32_t inode;
+        uint32_t parentBlock;
+        uint32_t pointer;
+    };
+
+    // Every anomaly found by the walks, ordered by inode.
+    std::vector<PointerAnomaly> getPointerAnomalies() const {
+        std::vector<PointerAnomaly> anomalies;
+        for (const std::vector<PointerAnomaly> &worker : workerAnomalies) {
+            anomalies.insert(anomalies.end(), worker.begin(), worker.end());
+        }
+        std::sort(anomalies.begin(), anomalies.end(), [](const PointerAnomaly &a, const PointerAnomaly &b) {
+            return std::tie(a.inode, a.parentBlock, a.pointer) < std::tie(b.inode, b.parentBlock, b.pointer);
+        });
+        return anomalies;
+    }
 
-            correctInodeBitmap(group, inodeBitmap, aggregatedInodeBitmap);
+    // Per-group counts of set bits in the block bitmaps as found on disk.
+    const std::vector<uint32_t> &getPreviousUsedBlockCounts() const {
+        return previousUsedBlockCounts;
+    }
 
-            fsReader.pwriteData(inodeBitmap.data(), inodeBitmap.size(), bgd.inode_bitmap * EXT2_BLOCK_SIZE(superBlock));
+    // Reads the whole image once, marking every non-empty block used and
+    // handing it to visitBlock(worker, block, data) for classification.
+    template <typename Visitor>
+    void scanImage(ThreadPool &pool, Visitor &&visitBlock) {
+        dispatchBlockSize(fsReader.getBlockSize(), [&](auto size) {
+            scanGroups<decltype(size)::value>(pool, visitBlock);
+        });
+        for (const Bitmap &partial : workerBitmaps) {
+            aggregatedBitmap.merge(partial);
         }
+        workerBitmaps.clear();
     }
 
-    void correctInodeBitmap(int group, std::vector<char> &inodeBitmap, const std::vector<char> &aggregatedInodeBitmap) {
-        int startInode = group * superBlock.inodes_per_group;
-        int endInode = std::min(startInode + superBlock.inodes_per_group, superBlock.inode_count);
+    void recoverBlockBitmaps(ThreadPool &pool) {
+        markMetadataBlocksUsed(aggregatedBitmap);
 
-        for (int i = startInode; i < endInode; ++i) {
-            int localIndex = i - startInode;
-            int byteIndex = localIndex / 8;
-            int bitIndex = localIndex % 8;
+        pool.parallelFor(fsReader.getBlockGroupCount(), [&](size_t group, unsigned) {
+            const ext2_block_group_descriptor &bgd = fsReader.getGroupDescriptor(group);
 
-            bool aggregateBit = (aggregatedInodeBitmap[i / 8] >> (i % 8)) & 1;
-            bool currentBit = (inodeBitmap[byteIndex] >> bitIndex) & 1;
+            std::vector<char> blockBitmap((superBlock.blocks_per_group + 7) / 8);
+            fsReader.preadData(blockBitmap.data(), blockBitmap.size(), fsReader.blockOffset(bgd.block_bitmap));
 
-            if (aggregateBit != currentBit) {
-                inodeBitmap[byteIndex] ^= (1 << bitIndex);
+            correctBlockBitmap(group, blockBitmap, aggregatedBitmap);
+            fsReader.pwriteData(blockBitmap.data(), blockBitmap.size(), fsReader.blockOffset(bgd.block_bitmap));
+        });
+    }
+
+private:
+    FileSystemReader &fsReader;
+    const std::vector<uint8_t> &dataIdentifier;
+    const ext2_super_block &superBlock;
+    // Bit i tracks block first_data_block + i, matching the group bitmaps.
+    BlockOwnershipIndex &ownership;
+    Bitmap aggregatedBitmap;
+    std::vector<Bitmap> workerBitmaps;
+    std::vector<uint32_t> usedBlockCounts;
+    std::vector<uint32_t> previousUsedBlockCounts;
+
+    // An indirect block still to be read.
+    struct PendingIndirect {
+        uint32_t block;
+        int level;
+        uint32_t inodeIndex;
+    };
+
+    std::vector<std::vector<PendingIndirect>> workerPending;
+    std::vector<std::vector<char>> workerScratch;
+    std::vector<std::vector<PointerAnomaly>> workerAnomalies;
+
+    // Pointer-block walker specialized for the image's block size, picked
+    // once in the constructor.
+    void (BlockBitmapRecovery::*indirectWalker)(unsigned, const PendingIndirect &, const uint32_t *) = nullptr;
+
+    Bitmap &bitmapFor(unsigned worker) {
+        return worker == 0 ? aggregatedBitmap : workerBitmaps[worker - 1];
+    }
+
+    // Body of scanImage; BlockSize is the block size, or 0 to use the
+    // runtime one.
+    template <uint32_t BlockSize, typename Visitor>
+    void scanGroups(ThreadPool &pool, Visitor &visitBlock) {
+        const uint32_t blockSize = BlockSize != 0 ? BlockSize : fsReader.getBlockSize();
+        pool.parallelFor(fsReader.getBlockGroupCount(), [&](size_t group, unsigned worker) {
+            Bitmap &partial = bitmapFor(worker);
+            uint32_t firstBlock = superBlock.first_data_block + group * superBlock.blocks_per_group;
+            uint32_t endBlock = std::min<uint64_t>(static_cast<uint64_t>(firstBlock) + superBlock.blocks_per_group,
+                                                   superBlock.block_count);
+            fsReader.scanBlocks(firstBlock, endBlock, [&](uint32_t chunkStart, const char *data, uint32_t blockCount) {
+                for (uint32_t i = 0; i < blockCount; ++i) {
+                    const char *block = data + static_cast<size_t>(i) * blockSize;
+                    if (!isBlockEmpty(block, blockSize)) {
+                        setBitInAggregatedBitmap(chunkStart + i, partial);
+                        visitBlock(worker, chunkStart + i, block);
+                    }
+                }
+            });
+        });
+    }
+
+    // Marks the blocks the inode points to directly and records them in the
+    // ownership index; the indirect blocks are queued for walkIndirectTrees.
+    void updateAggregatedBitmap(unsigned worker, uint32_t inodeIndex, const ext2_inode &inode) {
+        if (inode.mode == 0 || inode.link_count == 0) {
+            return;
+        }
+
+        Bitmap &aggregatedBitmap = bitmapFor(worker);
+        for (uint32_t i = 0; i < EXT2_NUM_DIRECT_BLOCKS; ++i) {
+            uint32_t block = inode.direct_blocks[i];
+            if (block != 0 && acceptPointer(worker, inodeIndex, 0, block)) {
+                setBitInAggregatedBitmap(block, aggregatedBitmap);
+                ownership.claim(block, inodeIndex);
             }
         }
+
+        const std::array<uint32_t, 3> indirectBlocks = {inode.single_indirect, inode.double_indirect, inode.triple_indirect};
+        for (int level = 1; level <= 3; ++level) {
+            uint32_t block = indirectBlocks[level - 1];
+            if (block != 0 && acceptPointer(worker, inodeIndex, 0, block)) {
+                setBitInAggregatedBitmap(block, aggregatedBitmap);
+                ownership.claim(block, inodeIndex);
+                workerPending[worker].push_back({block, level, inodeIndex});
+            }
+        }
+    }
+
+    // Marks and claims everything one indirect block points to, queueing
+    // the children of double and triple indirect blocks for the next level.
+    // BlockSize is the block size, or 0 to use the runtime one.
+    template <uint32_t BlockSize>
+    void walkIndirectBlock(unsigned worker, const PendingIndirect &pending, const uint32_t *blockPointers) {
+        const uint32_t pointerCount = (BlockSize != 0 ? BlockSize : fsReader.getBlockSize()) / sizeof(uint32_t);
+        Bitmap &aggregatedBitmap = bitmapFor(worker);
+
+        for (uint32_t i = 0; i < pointerCount; ++i) {
+            uint32_t pointer = blockPointers[i];
+            if (pointer != 0 && acceptPointer(worker, pending.inodeIndex, pending.block, pointer)) {
+                setBitInAggregatedBitmap(pointer, aggregatedBitmap);
+                ownership.claim(pointer, pending.inodeIndex);
+                if (pending.level > 1) {
+                    workerPending[worker].push_back({pointer, pending.level - 1, pending.inodeIndex});
+                }
+            }
+        }
+    }
+
+    // False, with the pointer recorded as an anomaly, when it lies outside
+    // the filesystem's data blocks.
+    bool acceptPointer(unsigned worker, uint32_t inodeIndex, uint32_t parentBlock, uint32_t pointer) {
+        if (pointer >= superBlock.first_data_block && pointer < superBlock.block_count) {
+            return true;
+        }
+        workerAnomalies[worker].push_back({inodeIndex, parentBlock, pointer});
+        return false;
+    }
+
+    std::vector<PendingIndirect> takePending() {
+        std::vector<PendingIndirect> pending;
+        for (std::vector<PendingIndirect> &worker : workerPending) {
+            pending.insert(pending.end(), worker.begin(), worker.end());
+            worker.clear();
+        }
+        return pending;
+    }
+
+    bool isBlockEmpty(const char *block, size_t size) const {
+        return isZeroBlock(block, size);
+    }
+
+    void setBitInAggregatedBitmap(uint32_t blockIndex, Bitmap &aggregatedBitmap) {
+        aggregatedBitmap.set(blockIndex - superBlock.first_data_block);
+    }
+
+    void markMetadataBlocksUsed(Bitmap &aggregatedBitmap) {
+        uint32_t blockGroupCount = fsReader.getBlockGroupCount();
+
+        for (uint32_t group = 0; group < blockGroupCount; ++group) {
+            const ext2_block_group_descriptor &bgd = fsReader.getGroupDescriptor(group);
+
+            uint32_t inodeTableSize = fsReader.getInodeTableBlocks();
+            uint32_t startBlock = group * superBlock.blocks_per_group;
+            uint32_t endBlock = bgd.inode_table + inodeTableSize - superBlock.first_data_block;
+            aggregatedBitmap.setRange(startBlock, endBlock);
+        }
+    }
+
+    void correctBlockBitmap(uint32_t group, std::vector<char> &blockBitmap, const Bitmap &aggregatedBitmap) {
+        Bitmap groupBitmap(superBlock.blocks_per_group);
+        groupBitmap.loadBytes(blockBitmap.data(), blockBitmap.size());
+        uint32_t startBlock = group * superBlock.blocks_per_group;
+        size_t groupBlocks = std::min<size_t>(superBlock.blocks_per_group, aggregatedBitmap.size() - startBlock);
+        previousUsedBlockCounts[group] = groupBitmap.count(0, groupBlocks);
+        aggregatedBitmap.orRangeInto(groupBitmap, 0, startBlock, superBlock.blocks_per_group);
+        // Bits past the last block of a partial last group are padding,
+        // which ext2 keeps set.
+        groupBitmap.setRange(groupBlocks, superBlock.blocks_per_group);
+        groupBitmap.storeBytes(blockBitmap.data(), blockBitmap.size());
+        usedBlockCounts[group] = groupBitmap.count(0, groupBlocks);
     }
 };
 
-class BlockBitmapRecovery {
-public:
-    BlockBitmapRecovery(FileSystemReader &fsReader, const std::vector<uint8_t> &dataIdentifier)
-        : fsReader(fsReader), dataIdentifier(dataIdentifier), superBlock(fsReader.getSuperblock()) {}
+// One live entry of a directory. name points into the mapped image or the
+// iterator's block buffer and stays valid until the next call to next().
+struct DirectoryEntryView {
+    uint32_t inode;
+    uint8_t fileType;
+    std::string_view name;
+};
 
-    void recoverBlockBitmaps() {
-        int blockGroupCount = (superBlock.block_count + superBlock.blocks_per_group - 1) / superBlock.blocks_per_group;
-        int totalBitmapSize = (superBlock.block_count + 7) / 8;
-        std::vector<char> aggregatedBitmap(totalBitmapSize, 0);
-        int blockSize = EXT2_BLOCK_SIZE(superBlock);
+// Streams the entries of one directory without materializing it: blocks are
+// fetched one at a time as the entries run out, direct blocks first and then
+// the indirect trees depth first. Only one data block and one pointer block
+// per indirect level are held at a time, and none at all when the image is
+// mapped.
+class DirectoryEntryIterator {
+public:
+    DirectoryEntryIterator(const FileSystemReader &fsReader, const ext2_inode &inode)
+        : fsReader(fsReader), blockSize(fsReader.getBlockSize()) {
+        std::copy(inode.direct_blocks, inode.direct_blocks + EXT2_NUM_DIRECT_BLOCKS, pointers.begin());
+        pointers[EXT2_NUM_DIRECT_BLOCKS] = inode.single_indirect;
+        pointers[EXT2_NUM_DIRECT_BLOCKS + 1] = inode.double_indirect;
+        pointers[EXT2_NUM_DIRECT_BLOCKS + 2] = inode.triple_indirect;
+    }
 
-        aggregateBlockBitmap(aggregatedBitmap);
+    // Moves to the next entry with a non-zero inode; false at the end.
+    bool next(DirectoryEntryView &entry) {
+        while (true) {
+            if (block != nullptr && offset + sizeof(ext2_dir_entry) <= blockSize) {
+                const ext2_dir_entry *raw = reinterpret_cast<const ext2_dir_entry *>(block + offset);
+                // A record too short for its own name, or running past the
+                // block, ends the chain of this block.
+                if (raw->length < sizeof(ext2_dir_entry) + raw->name_length || raw->length > blockSize - offset) {
+                    block = nullptr;
+                    continue;
+                }
+                // Ensure entry length is a multiple of 4 to avoid misalignment issues
+                offset = (offset + raw->length + 3) & ~3u;
+                if (raw->inode == 0) {
+                    continue;
+                }
+                entry = {raw->inode, raw->file_type, std::string_view(raw->name, raw->name_length)};
+                return true;
+            }
+            if (!advanceBlock()) {
+                return false;
+            }
+        }
+    }
 
-        for (int block = 0; block < superBlock.block_count; ++block) {
-            std::vector<char> buffer(blockSize);
-            fsReader.preadData(buffer.data(), blockSize, block * blockSize);
+private:
+    // A pointer block being walked and the index of its next pointer.
+    struct Frame {
+        BufferPool::Buffer buffer;
+        const uint32_t *pointers;
+        uint32_t index;
+        int level;
+    };
+
+    const FileSystemReader &fsReader;
+    uint32_t blockSize;
+    std::array<uint32_t, EXT2_NUM_DIRECT_BLOCKS + 3> pointers;
+    int slot = 0;
+    std::vector<Frame> frames;
+    BufferPool::Buffer blockBuffer;
+    const char *block = nullptr;
+    uint32_t offset = 0;
+
+    bool advanceBlock() {
+        uint32_t pointerCount = blockSize / sizeof(uint32_t);
+        while (true) {
+            uint32_t pointer;
+            int level;
+            if (!frames.empty()) {
+                Frame &frame = frames.back();
+                if (frame.index == pointerCount) {
+                    frames.pop_back();
+                    continue;
+                }
+                pointer = frame.pointers[frame.index++];
+                level = frame.level - 1;
+            } else if (slot < EXT2_NUM_DIRECT_BLOCKS + 3) {
+                pointer = pointers[slot];
+                level = slot < EXT2_NUM_DIRECT_BLOCKS ? 0 : slot - EXT2_NUM_DIRECT_BLOCKS + 1;
+                ++slot;
+            } else {
+                return false;
+            }
+            // Pointers outside the filesystem are skipped, not read.
+            if (pointer == 0 || pointer >= fsReader.getSuperblock().block_count) {
+                continue;
+            }
 
-            if (!isBlockEmpty(buffer)) {
-                setBitInAggregatedBitmap(block, aggregatedBitmap);
+            if (level > 0) {
+                Frame frame = {BufferPool::Buffer(), nullptr, 0, level};
+                frame.pointers = reinterpret_cast<const uint32_t *>(view(pointer, frame.buffer));
+                frames.push_back(std::move(frame));
+                continue;
             }
+            block = view(pointer, blockBuffer);
+            offset = 0;
+            return true;
         }
+    }
 
-        markMetadataBlocksUsed(aggregatedBitmap);
+    const char *view(uint32_t blockNumber, BufferPool::Buffer &buffer) {
+        if (buffer.data() == nullptr && !fsReader.isBlockMapped(blockNumber)) {
+            buffer = fsReader.acquireBlockBuffer();
+        }
+        return fsReader.blockView(blockNumber, buffer.data());
+    }
+};
+
+// Restores block pointers that were zeroed in otherwise intact inodes.
+// Damaged inodes are found during the inode walk from their size and
+// block_count_512; candidate blocks are the unowned ones the image scan
+// finds carrying the data identifier. Matching is a single ordered sweep,
+// so the cost stays near-linear in the number of holes and candidates.
+class PointerRecovery {
+public:
+    PointerRecovery(FileSystemReader &fsReader, const std::vector<uint8_t> &dataIdentifier, BlockOwnershipIndex &ownership)
+        : fsReader(fsReader), superBlock(fsReader.getSuperblock()), ownership(ownership),
+          signatures({dataIdentifier}) {}
+
+    void prepareWorkers(unsigned workerCount) {
+        workerInodes.assign(workerCount, {});
+        workerCandidates.assign(workerCount, {});
+        workerIndirectCandidates.assign(workerCount, {});
+        workerDirectoryCandidates.assign(workerCount, {});
+    }
 
-        for (int group = 0; group < blockGroupCount; ++group) {
-            ext2_block_group_descriptor bgd;
-            fsReader.preadData(&bgd, sizeof(bgd), 1024 + EXT2_SUPER_BLOCK_SIZE + group * sizeof(bgd));
+    // Called by the shared inode scan; remembers inodes whose pointers
+    // cannot account for the blocks they are charged for.
+    void visitInode(unsigned worker, uint32_t inodeIndex, const ext2_inode &inode) {
+        if (inode.mode == 0) {
+            return;
+        }
+        uint32_t blockSize = EXT2_BLOCK_SIZE(superBlock);
+        uint64_t dataBlocks = (inodeFileSize(inode) + blockSize - 1) / blockSize;
+        uint64_t allocatedBlocks = inode.block_count_512 / (blockSize / 512);
+        // Sparse files (and anything else charged for a different number of
+        // blocks) give no reliable way to tell a hole from a lost pointer.
+        if (dataBlocks == 0 || allocatedBlocks != denseBlockCount(dataBlocks)) {
+            return;
+        }
 
-            std::vector<char> blockBitmap(superBlock.blocks_per_group / 8);
-            fsReader.preadData(blockBitmap.data(), blockBitmap.size(), bgd.block_bitmap * EXT2_BLOCK_SIZE(superBlock));
+        DamagedInode damaged = {inodeIndex, (inode.mode & 0xF000) == EXT2_I_DTYPE, dataBlocks, 0, 0, {}};
+        std::copy(inode.direct_blocks, inode.direct_blocks + EXT2_NUM_DIRECT_BLOCKS, damaged.pointers.begin());
+        damaged.pointers[EXT2_NUM_DIRECT_BLOCKS] = inode.single_indirect;
+        damaged.pointers[EXT2_NUM_DIRECT_BLOCKS + 1] = inode.double_indirect;
+        damaged.pointers[EXT2_NUM_DIRECT_BLOCKS + 2] = inode.triple_indirect;
 
-            correctBlockBitmap(group, blockBitmap, aggregatedBitmap);
-            fsReader.pwriteData(blockBitmap.data(), blockBitmap.size(), bgd.block_bitmap * EXT2_BLOCK_SIZE(superBlock));
+        uint64_t directBlocks = std::min<uint64_t>(dataBlocks, EXT2_NUM_DIRECT_BLOCKS);
+        for (uint64_t slot = 0; slot < directBlocks; ++slot) {
+            if (damaged.pointers[slot] == 0) {
+                damaged.directHoles |= 1u << slot;
+            }
+        }
+        uint64_t covered = EXT2_NUM_DIRECT_BLOCKS;
+        uint64_t span = pointersPerBlock();
+        for (int level = 1; level <= 3 && dataBlocks > covered; ++level, span *= pointersPerBlock()) {
+            if (damaged.pointers[EXT2_NUM_DIRECT_BLOCKS + level - 1] == 0) {
+                damaged.indirectHoles |= 1u << (level - 1);
+            }
+            covered += span;
+        }
+
+        if (damaged.directHoles != 0 || damaged.indirectHoles != 0) {
+            workerInodes[worker].push_back(damaged);
+        }
+    }
+
+    // Called by the image scan for every non-empty block.
+    void visitBlock(unsigned worker, uint32_t block, const char *data) {
+        if (ownership.isOwned(block) || isMetadataBlock(block)) {
+            return;
+        }
+        if (signatures.match(data, EXT2_BLOCK_SIZE(superBlock)) == DATA_SIGNATURE) {
+            workerCandidates[worker].push_back(block);
+        } else if (isDirectoryBlock(data, EXT2_BLOCK_SIZE(superBlock), superBlock.inode_count)) {
+            uint32_t blockSize = EXT2_BLOCK_SIZE(superBlock);
+            workerDirectoryCandidates[worker].push_back(
+                {block, directorySelfInode(data, blockSize), directoryParentInode(data, blockSize)});
+        } else if (looksLikePointerBlock(reinterpret_cast<const uint32_t *>(data), pointersPerBlock(),
+                                         superBlock.first_data_block, superBlock.block_count)) {
+            workerIndirectCandidates[worker].push_back(block);
         }
     }
 
+    // A pointer written back into slot (an index into i_block) of an inode.
+    struct RestoredPointer {
+        uint32_t inode;
+        int slot;
+        uint32_t block;
+    };
+
+    // Fills the holes found during the walks, claims the adopted blocks and
+    // writes the repaired inodes back. Returns the restored pointers by inode.
+    std::vector<RestoredPointer> recoverPointers() {
+        std::vector<DamagedInode> damagedInodes;
+        for (std::vector<DamagedInode> &inodes : workerInodes) {
+            damagedInodes.insert(damagedInodes.end(), inodes.begin(), inodes.end());
+        }
+        std::vector<uint32_t> candidates = mergeWorkerBlocks(workerCandidates);
+        std::vector<uint32_t> indirectCandidates = mergeWorkerBlocks(workerIndirectCandidates);
+        std::vector<DirectoryBlock> directoryBlocks;
+        for (std::vector<DirectoryBlock> &blocks : workerDirectoryCandidates) {
+            directoryBlocks.insert(directoryBlocks.end(), blocks.begin(), blocks.end());
+        }
+        std::sort(directoryBlocks.begin(), directoryBlocks.end(),
+                  [](const DirectoryBlock &a, const DirectoryBlock &b) { return a.block < b.block; });
+        workerInodes.clear();
+        workerDirectoryCandidates.clear();
+
+        // Trees go first: the data and directory blocks under an orphaned
+        // indirect block are candidates too and must not be handed to
+        // direct holes.
+        Repairs repairs;
+        std::vector<uint32_t> leaves = candidates;
+        for (const DirectoryBlock &directoryBlock : directoryBlocks) {
+            leaves.push_back(directoryBlock.block);
+        }
+        reattachIndirectTrees(damagedInodes, leaves, indirectCandidates, repairs);
+        auto owned = [this](uint32_t block) { return ownership.isOwned(block); };
+        candidates.erase(std::remove_if(candidates.begin(), candidates.end(), owned), candidates.end());
+
+        std::vector<uint32_t> directoryCandidates = reconnectDirectoryBlocks(damagedInodes, directoryBlocks, repairs);
+        directoryCandidates.erase(std::remove_if(directoryCandidates.begin(), directoryCandidates.end(), owned),
+                                  directoryCandidates.end());
+        // Most holes sit inside a contiguous run and are settled by one
+        // lookup; only what the neighbours cannot explain goes to the sweep.
+        fillPredictedHoles(damagedInodes, candidates, false, repairs);
+        fillPredictedHoles(damagedInodes, directoryCandidates, true, repairs);
+        candidates.erase(std::remove_if(candidates.begin(), candidates.end(), owned), candidates.end());
+        directoryCandidates.erase(std::remove_if(directoryCandidates.begin(), directoryCandidates.end(), owned),
+                                  directoryCandidates.end());
+        fillDirectHoles(damagedInodes, candidates, false, repairs);
+        fillDirectHoles(damagedInodes, directoryCandidates, true, repairs);
+
+        std::vector<RestoredPointer> restored;
+        for (const auto &[inodeIndex, pointers] : repairs) {
+            ext2_inode inode;
+            fsReader.readInode(inodeIndex, &inode);
+            for (const auto &[slot, block] : pointers) {
+                setPointer(inode, slot, block);
+                restored.push_back({inodeIndex, slot, block});
+            }
+            fsReader.writeInode(inodeIndex, inode);
+        }
+        return restored;
+    }
+
 private:
+    // The 15 block pointers of an inode that lost some of them, with bit i
+    // of directHoles/indirectHoles set for each empty slot the size needs.
+    struct DamagedInode {
+        uint32_t inode;
+        bool directory;
+        uint64_t dataBlocks;
+        uint16_t directHoles;
+        uint8_t indirectHoles;
+        std::array<uint32_t, EXT2_NUM_DIRECT_BLOCKS + 3> pointers;
+    };
+
+    // A missing direct pointer and the pointers around it in the same inode.
+    struct Hole {
+        uint32_t lowerBound;
+        uint32_t inode;
+        int slot;
+        uint32_t upperBound;
+    };
+
+    // A missing indirect pointer and the number of data blocks the tree
+    // below it has to reach.
+    struct IndirectHole {
+        uint32_t lowerBound;
+        uint32_t inode;
+        int level;
+        uint64_t leafCount;
+    };
+
+    // An orphaned indirect block; level and leafCount stay 0 unless every
+    // block below it is orphaned too. Trees below another tree are
+    // referenced and never reattached on their own.
+    struct IndirectTree {
+        uint32_t block;
+        int level;
+        uint64_t leafCount;
+        bool referenced;
+    };
+
+    // An orphaned block that parses as a directory, with the inodes its "."
+    // and ".." entries name if it is the first block of that directory.
+    struct DirectoryBlock {
+        uint32_t block;
+        uint32_t selfInode;
+        uint32_t parentInode;
+    };
+
+    // Restored pointers per inode, as (i_block slot, block) pairs.
+    typedef std::map<uint32_t, std::vector<std::pair<int, uint32_t>>> Repairs;
+
+    // Index of the data identifier among the scanner's signatures.
+    static const int DATA_SIGNATURE = 0;
+
     FileSystemReader &fsReader;
-    const std::vector<uint8_t> &dataIdentifier;
     const ext2_super_block &superBlock;
+    BlockOwnershipIndex &ownership;
+    SignatureScanner signatures;
+    std::vector<std::vector<DamagedInode>> workerInodes;
+    std::vector<std::vector<uint32_t>> workerCandidates;
+    std::vector<std::vector<uint32_t>> workerIndirectCandidates;
+    std::vector<std::vector<DirectoryBlock>> workerDirectoryCandidates;
+
+    static std::vector<uint32_t> mergeWorkerBlocks(std::vector<std::vector<uint32_t>> &workerBlocks) {
+        std::vector<uint32_t> blocks;
+        for (std::vector<uint32_t> &partial : workerBlocks) {
+            blocks.insert(blocks.end(), partial.begin(), partial.end());
+        }
+        workerBlocks.clear();
+        std::sort(blocks.begin(), blocks.end());
+        return blocks;
+    }
 
-    void aggregateBlockBitmap(std::vector<char> &aggregatedBitmap) {
-        ext2_inode inode;
-        for (int i = 1; i <= superBlock.inode_count; ++i) {
-            fsReader.readInode(i, &inode);
-            updateAggregatedBitmap(inode, aggregatedBitmap);
+    static void setPointer(ext2_inode &inode, int slot, uint32_t block) {
+        if (slot < EXT2_NUM_DIRECT_BLOCKS) {
+            inode.direct_blocks[slot] = block;
+        } else if (slot == EXT2_NUM_DIRECT_BLOCKS) {
+            inode.single_indirect = block;
+        } else if (slot == EXT2_NUM_DIRECT_BLOCKS + 1) {
+            inode.double_indirect = block;
+        } else {
+            inode.triple_indirect = block;
         }
     }
 
-    void updateAggregatedBitmap(const ext2_inode &inode, std::vector<char> &aggregatedBitmap) {
-        if (inode.mode == 0 || inode.link_count == 0) {
+    uint64_t pointersPerBlock() const {
+        return EXT2_BLOCK_SIZE(superBlock) / sizeof(uint32_t);
+    }
+
+    // Blocks, data and indirect, that a file of dataBlocks blocks without
+    // holes occupies.
+    uint64_t denseBlockCount(uint64_t dataBlocks) const {
+        uint64_t pointers = pointersPerBlock();
+        uint64_t total = dataBlocks;
+        uint64_t remaining = dataBlocks > EXT2_NUM_DIRECT_BLOCKS ? dataBlocks - EXT2_NUM_DIRECT_BLOCKS : 0;
+        if (remaining > 0) {
+            total += 1;
+            remaining -= std::min(remaining, pointers);
+        }
+        if (remaining > 0) {
+            uint64_t covered = std::min(remaining, pointers * pointers);
+            total += 1 + (covered + pointers - 1) / pointers;
+            remaining -= covered;
+        }
+        if (remaining > 0) {
+            total += 1 + (remaining + pointers * pointers - 1) / (pointers * pointers) + (remaining + pointers - 1) / pointers;
+        }
+        return total;
+    }
+
+    bool isMetadataBlock(uint32_t block) const {
+        uint32_t group = (block - superBlock.first_data_block) / superBlock.blocks_per_group;
+        return block < fsReader.getGroupDescriptor(group).inode_table + fsReader.getInodeTableBlocks();
+    }
+
+    // Predicts each hole from the nearest pointer before it (that block plus
+    // the distance in slots) or, failing that, the nearest one after it; the
+    // single indirect block counts as the pointer after slot 11, since the
+    // allocator places it right behind the last direct block. A prediction
+    // is taken if it is a free candidate of the right kind. Filled holes
+    // update damagedInodes, so a run of holes extends one block at a time.
+    void fillPredictedHoles(std::vector<DamagedInode> &damagedInodes, const std::vector<uint32_t> &candidates, bool directories,
+                            Repairs &repairs) {
+        if (candidates.empty()) {
             return;
         }
+        Bitmap candidateMask(superBlock.block_count);
+        for (uint32_t block : candidates) {
+            candidateMask.set(block);
+        }
+        auto isFreeCandidate = [&](int64_t block) {
+            return block > 0 && block < superBlock.block_count && candidateMask.test(block) && !ownership.isOwned(block);
+        };
 
-        for (const auto &block : inode.direct_blocks) {
-            if (block != 0) {
-                setBitInAggregatedBitmap(block, aggregatedBitmap);
+        for (DamagedInode &damaged : damagedInodes) {
+            if (damaged.directory != directories || damaged.directHoles == 0) {
+                continue;
+            }
+            for (int slot = 0; slot < EXT2_NUM_DIRECT_BLOCKS; ++slot) {
+                if (!(damaged.directHoles & (1u << slot))) {
+                    continue;
+                }
+                int64_t predicted = 0;
+                for (int previous = slot - 1; previous >= 0; --previous) {
+                    if (damaged.pointers[previous] != 0) {
+                        predicted = static_cast<int64_t>(damaged.pointers[previous]) + (slot - previous);
+                        break;
+                    }
+                }
+                if (!isFreeCandidate(predicted)) {
+                    predicted = 0;
+                    for (int next = slot + 1; next <= EXT2_NUM_DIRECT_BLOCKS; ++next) {
+                        if (damaged.pointers[next] != 0) {
+                            predicted = static_cast<int64_t>(damaged.pointers[next]) - (next - slot);
+                            break;
+                        }
+                    }
+                }
+                if (!isFreeCandidate(predicted) || !ownership.claim(predicted, damaged.inode)) {
+                    continue;
+                }
+                candidateMask.clear(predicted);
+                repairs[damaged.inode].push_back({slot, static_cast<uint32_t>(predicted)});
+                damaged.pointers[slot] = predicted;
+                damaged.directHoles &= ~(1u << slot);
             }
         }
+    }
 
-        const std::array<std::pair<uint32_t, int>, 3> indirectBlocks = {
-            std::make_pair(inode.single_indirect, 1),
-            std::make_pair(inode.double_indirect, 2),
-            std::make_pair(inode.triple_indirect, 3)
+    // Gives each hole in a regular file (or, with directories set, in a
+    // directory) the lowest free candidate above the
+    // previous pointer of its inode and below the next one. Holes are taken
+    // in order of that lower bound, so several holes in one inode receive
+    // ascending blocks. Taken candidates are skipped through a path-compressed
+    // "next free" table, which keeps the sweep near-linear.
+    void fillDirectHoles(const std::vector<DamagedInode> &damagedInodes, const std::vector<uint32_t> &candidates, bool directories,
+                         Repairs &repairs) {
+        std::vector<Hole> holes;
+        for (const DamagedInode &damaged : damagedInodes) {
+            if (damaged.directory != directories || damaged.directHoles == 0) {
+                continue;
+            }
+            uint32_t lowerBound = 0;
+            for (int slot = 0; slot < EXT2_NUM_DIRECT_BLOCKS; ++slot) {
+                if (damaged.pointers[slot] != 0) {
+                    lowerBound = damaged.pointers[slot];
+                    continue;
+                }
+                if (!(damaged.directHoles & (1u << slot))) {
+                    continue;
+                }
+                uint32_t upperBound = superBlock.block_count;
+                for (int next = slot + 1; next < EXT2_NUM_DIRECT_BLOCKS; ++next) {
+                    if (damaged.pointers[next] != 0) {
+                        upperBound = damaged.pointers[next];
+                        break;
+                    }
+                }
+                holes.push_back({lowerBound, damaged.inode, slot, upperBound});
+            }
+        }
+        std::sort(holes.begin(), holes.end(), [](const Hole &a, const Hole &b) {
+            return std::tie(a.lowerBound, a.inode, a.slot) < std::tie(b.lowerBound, b.inode, b.slot);
+        });
+
+        std::vector<size_t> nextFree(candidates.size() + 1);
+        for (size_t i = 0; i < nextFree.size(); ++i) {
+            nextFree[i] = i;
+        }
+        auto findFree = [&](size_t index) {
+            size_t root = index;
+            while (nextFree[root] != root) {
+                root = nextFree[root];
+            }
+            while (nextFree[index] != root) {
+                size_t next = nextFree[index];
+                nextFree[index] = root;
+                index = next;
+            }
+            return root;
         };
 
-        for (const auto &[block, level] : indirectBlocks) {
-            updateBitmapForIndirectBlocks(block, level, aggregatedBitmap);
-            setBitInAggregatedBitmap(block, aggregatedBitmap);
+        for (const Hole &hole : holes) {
+            size_t index = std::upper_bound(candidates.begin(), candidates.end(), hole.lowerBound) - candidates.begin();
+            index = findFree(index);
+            if (index == candidates.size() || candidates[index] >= hole.upperBound) {
+                continue;
+            }
+            nextFree[index] = index + 1;
+            if (ownership.claim(candidates[index], hole.inode)) {
+                repairs[hole.inode].push_back({hole.slot, candidates[index]});
+            }
         }
     }
 
-    void updateBitmapForIndirectBlocks(uint32_t blockIndex, int level, std::vector<char> &aggregatedBitmap) {
-        if (blockIndex == 0) {
-            return;
+    // How well the ".." entry of a first block fits the directory named by
+    // its "." entry; higher is better and NO_PARENT rules the block out.
+    enum ParentMatch { NO_PARENT, PARENT_IS_DIRECTORY, PARENT_LISTS_CHILD };
+
+    // The parent must be a live directory; it fits best when one of its
+    // entries names the child, which is what ties the block into the tree.
+    ParentMatch matchParent(const DirectoryBlock &directoryBlock) const {
+        uint32_t parentIndex = directoryBlock.parentInode;
+        if (parentIndex == 0 || parentIndex > superBlock.inode_count) {
+            return NO_PARENT;
+        }
+        ext2_inode parent;
+        fsReader.readInode(parentIndex, &parent);
+        if (parent.link_count == 0 || (parent.mode & 0xF000) != EXT2_I_DTYPE) {
+            return NO_PARENT;
         }
+        DirectoryEntryIterator entries(fsReader, parent);
+        DirectoryEntryView entry;
+        while (entries.next(entry)) {
+            if (entry.inode == directoryBlock.selfInode && entry.name != "." && entry.name != "..") {
+                return PARENT_LISTS_CHILD;
+            }
+        }
+        return PARENT_IS_DIRECTORY;
+    }
 
-        int blockSize = EXT2_BLOCK_SIZE(superBlock);
-        std::vector<uint32_t> blockPointers(blockSize / sizeof(uint32_t));
-        fsReader.preadData(blockPointers.data(), blockSize, blockIndex * blockSize);
+    // Gives a directory that lost its first block the orphaned block whose
+    // "." entry names it and whose ".." entry names its parent, and updates
+    // damagedInodes to match. When stale copies of a first block compete,
+    // the one whose parent still lists the directory wins. Returns the
+    // orphaned directory blocks left over, in ascending order.
+    std::vector<uint32_t> reconnectDirectoryBlocks(std::vector<DamagedInode> &damagedInodes,
+                                                   const std::vector<DirectoryBlock> &directoryBlocks, Repairs &repairs) {
+        std::map<uint32_t, std::vector<const DirectoryBlock *>> firstBlocks;
+        for (const DirectoryBlock &directoryBlock : directoryBlocks) {
+            if (directoryBlock.selfInode != 0 && !ownership.isOwned(directoryBlock.block)) {
+                firstBlocks[directoryBlock.selfInode].push_back(&directoryBlock);
+            }
+        }
 
-        for (const auto &pointer : blockPointers) {
-            if (pointer != 0) {
-                setBitInAggregatedBitmap(pointer, aggregatedBitmap);
-                if (level > 1) {
-                    updateBitmapForIndirectBlocks(pointer, level - 1, aggregatedBitmap);
+        for (DamagedInode &damaged : damagedInodes) {
+            if (!damaged.directory || !(damaged.directHoles & 1u)) {
+                continue;
+            }
+            auto first = firstBlocks.find(damaged.inode);
+            if (first == firstBlocks.end()) {
+                continue;
+            }
+            const DirectoryBlock *best = nullptr;
+            ParentMatch bestMatch = NO_PARENT;
+            for (const DirectoryBlock *directoryBlock : first->second) {
+                ParentMatch match = matchParent(*directoryBlock);
+                if (match > bestMatch) {
+                    best = directoryBlock;
+                    bestMatch = match;
+                }
+                if (bestMatch == PARENT_LISTS_CHILD) {
+                    break;
                 }
             }
+            if (best == nullptr || !ownership.claim(best->block, damaged.inode)) {
+                continue;
+            }
+            repairs[damaged.inode].push_back({0, best->block});
+            damaged.pointers[0] = best->block;
+            damaged.directHoles &= ~1u;
         }
-    }
 
-    bool isBlockEmpty(const std::vector<char> &block) const {
-        return std::all_of(block.begin(), block.end(), [](char c) { return c == 0; });
-    }
-
-    void setBitInAggregatedBitmap(uint32_t blockIndex, std::vector<char> &aggregatedBitmap) {
-        aggregatedBitmap[blockIndex / 8] |= (1 << (blockIndex % 8));
+        // A "." block no hole asked for may still be a later block of a
+        // directory that was emptied and reused; keep it as a candidate.
+        std::vector<uint32_t> remaining;
+        for (const DirectoryBlock &directoryBlock : directoryBlocks) {
+            if (!ownership.isOwned(directoryBlock.block)) {
+                remaining.push_back(directoryBlock.block);
+            }
+        }
+        return remaining;
     }
 
-    void markMetadataBlocksUsed(std::vector<char> &aggregatedBitmap) {
-        int blockGroupCount = (superBlock.block_count + superBlock.blocks_per_group - 1) / superBlock.blocks_per_group;
-        int blockSize = EXT2_BLOCK_SIZE(superBlock);
+    // Rebuilds orphaned indirect trees bottom up from the classified
+    // candidates, then gives each missing indirect pointer the first free
+    // root above its inode's previous pointer among the trees of the right
+    // depth that reach exactly the number of data blocks the size implies.
+    void reattachIndirectTrees(const std::vector<DamagedInode> &damagedInodes, const std::vector<uint32_t> &leaves,
+                               const std::vector<uint32_t> &indirectCandidates, Repairs &repairs) {
+        if (indirectCandidates.empty()) {
+            return;
+        }
+        std::vector<IndirectTree> trees;
+        for (uint32_t block : indirectCandidates) {
+            trees.push_back({block, 0, 0, false});
+        }
+        classifyIndirectTrees(trees, leaves);
 
-        for (int group = 0; group < blockGroupCount; ++group) {
-            ext2_block_group_descriptor bgd;
-            fsReader.preadData(&bgd, sizeof(bgd), 1024 + EXT2_SUPER_BLOCK_SIZE + group * sizeof(bgd));
+        std::map<std::pair<int, uint64_t>, std::set<uint32_t>> roots;
+        for (const IndirectTree &tree : trees) {
+            if (tree.level != 0 && !tree.referenced) {
+                roots[{tree.level, tree.leafCount}].insert(tree.block);
+            }
+        }
 
-            int inodeTableSize = (superBlock.inodes_per_group + blockSize / EXT2_INODE_SIZE - 1) / (blockSize / EXT2_INODE_SIZE);
-            int endBlock = bgd.inode_table + inodeTableSize;
-            for (int i = group * superBlock.blocks_per_group; i < endBlock; ++i) {
-                setBitInAggregatedBitmap(i, aggregatedBitmap);
+        std::vector<IndirectHole> holes;
+        for (const DamagedInode &damaged : damagedInodes) {
+            uint32_t lowerBound = 0;
+            uint64_t covered = EXT2_NUM_DIRECT_BLOCKS;
+            uint64_t span = pointersPerBlock();
+            for (int slot = 0; slot < EXT2_NUM_DIRECT_BLOCKS; ++slot) {
+                lowerBound = std::max(lowerBound, damaged.pointers[slot]);
+            }
+            for (int level = 1; level <= 3 && damaged.dataBlocks > covered; ++level, span *= pointersPerBlock()) {
+                if (damaged.indirectHoles & (1u << (level - 1))) {
+                    holes.push_back({lowerBound, damaged.inode, level, std::min(damaged.dataBlocks - covered, span)});
+                }
+                lowerBound = std::max(lowerBound, damaged.pointers[EXT2_NUM_DIRECT_BLOCKS + level - 1]);
+                covered += span;
+            }
+        }
+        std::sort(holes.begin(), holes.end(), [](const IndirectHole &a, const IndirectHole &b) {
+            return std::tie(a.lowerBound, a.inode, a.level) < std::tie(b.lowerBound, b.inode, b.level);
+        });
+
+        for (const IndirectHole &hole : holes) {
+            auto match = roots.find({hole.level, hole.leafCount});
+            if (match == roots.end() || match->second.empty()) {
+                continue;
+            }
+            std::set<uint32_t> &blocks = match->second;
+            auto root = blocks.upper_bound(hole.lowerBound);
+            if (root == blocks.end()) {
+                root = blocks.begin();
+            }
+            uint32_t block = *root;
+            blocks.erase(root);
+            if (claimIndirectTree(block, hole.level, hole.inode)) {
+                repairs[hole.inode].push_back({EXT2_NUM_DIRECT_BLOCKS + hole.level - 1, block});
             }
         }
     }
 
-    void correctBlockBitmap(int group, std::vector<char> &blockBitmap, const std::vector<char> &aggregatedBitmap) {
-        int startBlock = group * superBlock.blocks_per_group;
-        int endBlock = std::min(startBlock + superBlock.blocks_per_group, superBlock.block_count);
+    // A candidate is a level L tree if every pointer in it leads to an
+    // orphaned data or directory block (L == 1) or to a level L - 1 tree.
+    // trees must be sorted by block.
+    void classifyIndirectTrees(std::vector<IndirectTree> &trees, const std::vector<uint32_t> &leafBlocks) {
+        Bitmap leaves(superBlock.block_count);
+        for (uint32_t block : leafBlocks) {
+            leaves.set(block);
+        }
+        auto findTree = [&](uint32_t block) -> IndirectTree * {
+            auto tree = std::lower_bound(trees.begin(), trees.end(), block,
+                                         [](const IndirectTree &t, uint32_t value) { return t.block < value; });
+            return tree != trees.end() && tree->block == block ? &*tree : nullptr;
+        };
 
-        for (int i = startBlock; i < endBlock; ++i) {
-            int byteIndex = (i - startBlock) / 8;
-            int bitIndex = (i - startBlock) % 8;
+        std::vector<IndirectTree *> children;
+        for (int level = 1; level <= 3; ++level) {
+            for (IndirectTree &tree : trees) {
+                if (tree.level != 0) {
+                    continue;
+                }
+                BufferPool::Buffer scratch = fsReader.acquireBlockBuffer();
+                const uint32_t *entries = reinterpret_cast<const uint32_t *>(fsReader.blockView(tree.block, scratch.data()));
+                uint64_t leafCount = 0;
+                bool valid = true;
+                children.clear();
+                for (uint64_t i = 0; i < pointersPerBlock() && valid; ++i) {
+                    uint32_t child = entries[i];
+                    if (child == 0) {
+                        continue;
+                    }
+                    if (level == 1) {
+                        valid = child < leaves.size() && leaves.test(child);
+                        ++leafCount;
+                    } else {
+                        IndirectTree *subtree = findTree(child);
+                        valid = subtree != nullptr && subtree->level == level - 1;
+                        if (valid) {
+                            leafCount += subtree->leafCount;
+                            children.push_back(subtree);
+                        }
+                    }
+                }
+                if (valid) {
+                    tree.level = level;
+                    tree.leafCount = leafCount;
+                    for (IndirectTree *child : children) {
+                        child->referenced = true;
+                    }
+                }
+            }
+        }
+    }
 
-            if ((aggregatedBitmap[i / 8] >> (i % 8)) & 1) {
-                blockBitmap[byteIndex] |= (1 << bitIndex);
+    // Claims an indirect block and everything below it for inodeIndex.
+    // Fails without claiming anything below if the root is already owned.
+    bool claimIndirectTree(uint32_t block, int level, uint32_t inodeIndex) {
+        if (!ownership.claim(block, inodeIndex)) {
+            return false;
+        }
+        BufferPool::Buffer scratch = fsReader.acquireBlockBuffer();
+        const uint32_t *entries = reinterpret_cast<const uint32_t *>(fsReader.blockView(block, scratch.data()));
+        for (uint64_t i = 0; i < pointersPerBlock(); ++i) {
+            uint32_t child = entries[i];
+            if (child == 0) {
+                continue;
+            }
+            if (level > 1) {
+                claimIndirectTree(child, level - 1, inodeIndex);
+            } else {
+                ownership.claim(child, inodeIndex);
             }
         }
+        return true;
     }
 };
 
+struct RecoveryOptions {
+    unsigned queueDepth = BLOCK_SCAN_QUEUE_DEPTH;
+    bool updateCounters = false;
+    unsigned jobs = 1;
+    // Stream NDJSON records instead of the superblock dump and text tree.
+    bool ndjson = false;
+    // File the directory tree (or the NDJSON stream) is written to instead
+    // of stdout.
+    std::string treeOutput;
+};
+
 class Ext2Recovery {
 public:
-    Ext2Recovery(const std::string &imagePath, const std::vector<uint8_t> &dataIdentifier)
-        : fsReader(imagePath), inodeBitmapRecovery(fsReader, dataIdentifier), blockBitmapRecovery(fsReader, dataIdentifier) {}
+    // With a report, repairs are streamed as NDJSON records after each stage
+    // and the superblock is reported as a record instead of printed.
+    Ext2Recovery(const std::string &imagePath, const std::vector<uint8_t> &dataIdentifier, const RecoveryOptions &options,
+                 NdjsonWriter *report = nullptr)
+        : fsReader(imagePath), ownership(fsReader.getSuperblock().block_count),
+          inodeBitmapRecovery(fsReader, dataIdentifier), blockBitmapRecovery(fsReader, dataIdentifier, ownership),
+          pointerRecovery(fsReader, dataIdentifier, ownership),
+          updateCounters(options.updateCounters), report(report), pool(options.jobs) {
+        fsReader.setScanQueueDepth(options.queueDepth);
+    }
 
     void recover() {
         printSuperBlock();
-        inodeBitmapRecovery.recoverInodeBitmaps();
-        blockBitmapRecovery.recoverBlockBitmaps();
+        // One sequential pass over the inode tables feeds both recoveries;
+        // each worker takes whole block groups.
+        inodeBitmapRecovery.prepareWorkers(pool.size());
+        blockBitmapRecovery.prepareWorkers(pool.size());
+        pointerRecovery.prepareWorkers(pool.size());
+        pool.parallelFor(fsReader.getBlockGroupCount(), [this](size_t group, unsigned worker) {
+            fsReader.scanInodeGroup(group, [&](uint32_t inodeIndex, const ext2_inode &inode) {
+                inodeBitmapRecovery.visitInode(worker, inodeIndex, inode);
+                blockBitmapRecovery.visitInode(worker, inodeIndex, inode);
+                pointerRecovery.visitInode(worker, inodeIndex, inode);
+            });
+        });
+        blockBitmapRecovery.walkIndirectTrees(pool);
+        inodeBitmapRecovery.recoverInodeBitmaps(pool);
+        reportBitmapRepairs("inode_bitmap", inodeBitmapRecovery.getPreviousUsedInodeCounts(),
+                            inodeBitmapRecovery.getUsedInodeCounts());
+        // The image scan runs once the walk has filled the ownership index,
+        // so unowned blocks can be classified as they stream past.
+        blockBitmapRecovery.scanImage(pool, [this](unsigned worker, uint32_t block, const char *data) {
+            pointerRecovery.visitBlock(worker, block, data);
+        });
+        reportPointerRepairs(pointerRecovery.recoverPointers());
+        blockBitmapRecovery.recoverBlockBitmaps(pool);
+        reportBitmapRepairs("block_bitmap", blockBitmapRecovery.getPreviousUsedBlockCounts(),
+                            blockBitmapRecovery.getUsedBlockCounts());
+        if (updateCounters) {
+            finalizeCounters();
+        }
+        reportCrossLinks();
+        reportPointerAnomalies();
     }
 
     FileSystemReader &getFileSystemReader() {
@@ -276,144 +1603,361 @@ public:
 
 private:
     FileSystemReader fsReader;
+    BlockOwnershipIndex ownership;
     InodeBitmapRecovery inodeBitmapRecovery;
     BlockBitmapRecovery blockBitmapRecovery;
+    PointerRecovery pointerRecovery;
+    bool updateCounters;
+    NdjsonWriter *report;
+    ThreadPool pool;
+
+    // Derives the free block/inode and directory counters from the repaired
+    // bitmaps so the image is consistent without a separate fsck pass.
+    void finalizeCounters() {
+        const ext2_super_block &superBlock = fsReader.getSuperblock();
+        const std::vector<uint32_t> &usedBlocks = blockBitmapRecovery.getUsedBlockCounts();
+        const std::vector<uint32_t> &usedInodes = inodeBitmapRecovery.getUsedInodeCounts();
+        const std::vector<uint32_t> &usedDirs = inodeBitmapRecovery.getUsedDirsCounts();
+
+        std::vector<ext2_block_group_descriptor> descriptors;
+        uint32_t freeBlockCount = 0;
+        uint32_t freeInodeCount = 0;
+        for (uint32_t group = 0; group < fsReader.getBlockGroupCount(); ++group) {
+            uint32_t firstBlock = superBlock.first_data_block + group * superBlock.blocks_per_group;
+            uint32_t groupBlocks = std::min(superBlock.blocks_per_group, superBlock.block_count - firstBlock);
+            uint64_t firstInode = static_cast<uint64_t>(group) * superBlock.inodes_per_group;
+            uint32_t groupInodes = firstInode < superBlock.inode_count
+                                       ? std::min<uint64_t>(superBlock.inodes_per_group, superBlock.inode_count - firstInode) : 0;
+
+            ext2_block_group_descriptor bgd = fsReader.getGroupDescriptor(group);
+            bgd.free_block_count = groupBlocks - usedBlocks[group];
+            bgd.free_inode_count = groupInodes - usedInodes[group];
+            bgd.used_dirs_count = usedDirs[group];
+            freeBlockCount += bgd.free_block_count;
+            freeInodeCount += bgd.free_inode_count;
+            descriptors.push_back(bgd);
+        }
+        fsReader.writeCounters(descriptors, freeBlockCount, freeInodeCount);
+        if (report != nullptr) {
+            report->beginRecord("repair");
+            report->field("action", "counters");
+            report->field("free_blocks", freeBlockCount);
+            report->field("free_inodes", freeInodeCount);
+            report->endRecord();
+            report->flush();
+        }
+    }
+
+    // One record per group whose bitmap changed.
+    void reportBitmapRepairs(std::string_view action, const std::vector<uint32_t> &previousUsed, const std::vector<uint32_t> &used) {
+        if (report == nullptr) {
+            return;
+        }
+        for (size_t group = 0; group < used.size(); ++group) {
+            if (previousUsed[group] == used[group]) {
+                continue;
+            }
+            report->beginRecord("repair");
+            report->field("action", action);
+            report->field("group", group);
+            report->field("used_before", previousUsed[group]);
+            report->field("used_after", used[group]);
+            report->endRecord();
+        }
+        report->flush();
+    }
+
+    void reportPointerRepairs(const std::vector<PointerRecovery::RestoredPointer> &restored) {
+        if (report == nullptr) {
+            return;
+        }
+        for (const PointerRecovery::RestoredPointer &pointer : restored) {
+            report->beginRecord("repair");
+            report->field("action", "pointer");
+            report->field("inode", pointer.inode);
+            report->field("slot", pointer.slot);
+            report->field("block", pointer.block);
+            report->endRecord();
+        }
+        report->flush();
+    }
+
+    void reportPointerAnomalies() {
+        for (const BlockBitmapRecovery::PointerAnomaly &anomaly : blockBitmapRecovery.getPointerAnomalies()) {
+            std::cerr << "Warning: inode " << anomaly.inode << " points to block " << anomaly.pointer;
+            if (anomaly.parentBlock != 0) {
+                std::cerr << " from indirect block " << anomaly.parentBlock;
+            }
+            std::cerr << ", outside the filesystem" << std::endl;
+        }
+    }
+
+    void reportCrossLinks() {
+        for (const BlockOwnershipIndex::CrossLink &link : ownership.getCrossLinks()) {
+            std::cerr << "Warning: block " << link.block << " is claimed by inode " << link.firstInode
+                      << " and inode " << link.secondInode << std::endl;
+        }
+    }
 
     void printSuperBlock() {
         const ext2_super_block &superBlock = fsReader.getSuperblock();
+        if (report != nullptr) {
+            report->beginRecord("superblock");
+            report->field("block_size", fsReader.getBlockSize());
+            report->field("block_count", superBlock.block_count);
+            report->field("inode_count", superBlock.inode_count);
+            report->field("blocks_per_group", superBlock.blocks_per_group);
+            report->field("inodes_per_group", superBlock.inodes_per_group);
+            report->endRecord();
+            report->flush();
+            return;
+        }
         print_super_block(&superBlock);
+        // The tree is written to the fd directly, behind stdio's back.
+        fflush(stdout);
     }
 };
 
 class DirectoryTraversal {
 public:
-    DirectoryTraversal(FileSystemReader &fsReader)
-        : fsReader(fsReader), superBlock(fsReader.getSuperblock()) {}
-
+    // With json set, each entry becomes an NDJSON record instead of a line
+    // of the dash-indented tree.
+    DirectoryTraversal(FileSystemReader &fsReader, OutputWriter &output, NdjsonWriter *json = nullptr)
+        : fsReader(fsReader), superBlock(fsReader.getSuperblock()), output(output), json(json) {}
+
+    // Prints the tree depth first, children in directory order. A directory
+    // reached a second time (a cycle in a corrupt image) or below
+    // MAX_TRAVERSAL_DEPTH is printed but not entered.
     void printDirectoryTree() {
         ext2_inode rootInode;
         fsReader.readInode(EXT2_ROOT_INODE, &rootInode);
-        std::map<uint32_t, std::string> inodeToName;
-        inodeToName[EXT2_ROOT_INODE] = "root";
-        traverseDirectory(EXT2_ROOT_INODE, rootInode, 0, inodeToName);
-    }
-
-private:
-    FileSystemReader &fsReader;
-    const ext2_super_block &superBlock;
-
-    void traverseDirectory(uint32_t inodeNumber, const ext2_inode &inode, int depth, std::map<uint32_t, std::string> &inodeToName) {
-        std::vector<ext2_dir_entry*> dirEntries = readDirectoryEntries(inode);
-        for (ext2_dir_entry *entry : dirEntries) {
-            if (entry->inode == 0) continue; // Skip invalid entries
-
-            std::string entryName(entry->name, entry->name_length & 0xFF);
-            if (entryName == "." || entryName == "..") continue; // Skip self and parent directories
-
-            inodeToName[entry->inode] = entryName;
-
-            // Print the current directory/file with proper indentation
-            for (int i = 0; i < depth + 1; ++i) {
-                std::cout << "-";
+        Bitmap visited(superBlock.inode_count);
+        visited.set(EXT2_ROOT_INODE - 1);
+
+        // One frame per open directory, so memory grows with depth and the
+        // size of the directories on the current path only.
+        std::stack<Frame> frames;
+        frames.emplace();
+        openDirectory(frames.top(), rootInode, 0, 0);
+        // Path of the current entry; each frame remembers the length of its
+        // directory's path.
+        std::string path;
+        while (!frames.empty()) {
+            Frame &frame = frames.top();
+            if (frame.next == frame.children.size()) {
+                frames.pop();
+                continue;
             }
-
-            ext2_inode childInode;
-            fsReader.readInode(entry->inode, &childInode);
-            bool isDirectory = (childInode.mode & 0xF000) == EXT2_I_DTYPE;
-
-            std::cout << " " << entryName;
-            if (isDirectory) {
-                std::cout << "/";
+            const Child &child = frame.children[frame.next++];
+            std::string_view name(frame.names.data() + child.nameOffset, child.nameLength);
+            bool isDirectory = child.valid && (child.mode & 0xF000) == EXT2_I_DTYPE;
+
+            path.resize(frame.pathLength);
+            path += '/';
+            path += name;
+            if (json != nullptr) {
+                writeEntryRecord(path, child);
+            } else {
+                // Print the current directory/file with proper indentation
+                output.repeat('-', frame.depth + 1);
+                output.put(' ');
+                output.write(name);
+                if (isDirectory) {
+                    output.put('/');
+                }
+                output.put('\n');
             }
-            std::cout << std::endl;
 
-            // Recursively traverse subdirectories
-            if (isDirectory) {
-                traverseDirectory(entry->inode, childInode, depth + 1, inodeToName);
+            if (!isDirectory) {
+                continue;
+            }
+            if (visited.test(child.inodeIndex - 1)) {
+                std::cerr << "Warning: directory inode " << child.inodeIndex << " is linked more than once; not entering it again" << std::endl;
+            } else if (frame.depth + 1 >= MAX_TRAVERSAL_DEPTH) {
+                std::cerr << "Warning: directory inode " << child.inodeIndex << " is deeper than " << MAX_TRAVERSAL_DEPTH << " levels; not entering it" << std::endl;
+            } else {
+                visited.set(child.inodeIndex - 1);
+                int depth = frame.depth + 1;
+                ext2_inode directoryInode;
+                fsReader.readInode(child.inodeIndex, &directoryInode);
+                frames.emplace();
+                openDirectory(frames.top(), directoryInode, depth, path.size());
             }
         }
+        output.flush();
     }
 
-    std::vector<ext2_dir_entry*> readDirectoryEntries(const ext2_inode &inode) {
-        std::vector<ext2_dir_entry*> entries;
-        int blockSize = EXT2_BLOCK_SIZE(superBlock);
-
-        // Read direct blocks
-        for (int i = 0; i < EXT2_NUM_DIRECT_BLOCKS; ++i) {
-            if (inode.direct_blocks[i] == 0) continue;
-            readDirectoryEntriesFromBlock(inode.direct_blocks[i], entries);
-        }
+private:
+    // An entry of an open directory with the inode fields the printer needs
+    // already fetched; valid is false when the entry names an inode outside
+    // the table. A directory's own inode is read again when it is entered,
+    // so open frames stay small however wide the directories are.
+    struct Child {
+        uint32_t inodeIndex;
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        bool valid;
+        uint16_t mode;
+        uint64_t size;
+    };
+
+    struct Frame {
+        std::vector<Child> children;
+        std::string names;
+        size_t next = 0;
+        int depth = 0;
+        size_t pathLength = 0;
+    };
 
-        // Read single indirect block
-        if (inode.single_indirect != 0) {
-            readIndirectBlocks(inode.single_indirect, 1, entries);
+    FileSystemReader &fsReader;
+    const ext2_super_block &superBlock;
+    OutputWriter &output;
+    NdjsonWriter *json;
+
+    // Lists the directory, then fetches every child inode in one sorted
+    // batch instead of one random read per entry.
+    void openDirectory(Frame &frame, const ext2_inode &inode, int depth, size_t pathLength) {
+        frame.depth = depth;
+        frame.pathLength = pathLength;
+
+        DirectoryEntryIterator entries(fsReader, inode);
+        DirectoryEntryView entry;
+        std::vector<std::pair<uint32_t, uint32_t>> order;
+        while (entries.next(entry)) {
+            if (entry.name == "." || entry.name == "..") continue; // Skip self and parent directories
+            bool valid = entry.inode <= superBlock.inode_count;
+            if (valid) {
+                order.push_back({entry.inode, static_cast<uint32_t>(frame.children.size())});
+            }
+            frame.children.push_back({entry.inode, static_cast<uint32_t>(frame.names.size()),
+                                      static_cast<uint32_t>(entry.name.size()), valid, 0, 0});
+            frame.names += entry.name;
         }
 
-        // Read double indirect block
-        if (inode.double_indirect != 0) {
-            readIndirectBlocks(inode.double_indirect, 2, entries);
+        std::sort(order.begin(), order.end());
+        std::vector<uint32_t> inodeIndexes;
+        for (const auto &[inodeIndex, position] : order) {
+            inodeIndexes.push_back(inodeIndex);
         }
+        size_t fetched = 0;
+        fsReader.readInodeBatch(inodeIndexes, [&](uint32_t, const ext2_inode &childInode) {
+            Child &child = frame.children[order[fetched++].second];
+            child.mode = childInode.mode;
+            child.size = inodeFileSize(childInode);
+        });
+    }
 
-        // Read triple indirect block
-        if (inode.triple_indirect != 0) {
-            readIndirectBlocks(inode.triple_indirect, 3, entries);
+    void writeEntryRecord(const std::string &path, const Child &child) {
+        json->beginRecord("entry");
+        json->field("path", path);
+        json->field("inode", child.inodeIndex);
+        json->field("type", child.valid ? fileTypeName(child.mode) : "unknown");
+        if (child.valid) {
+            json->field("size", child.size);
         }
-
-        return entries;
+        json->endRecord();
     }
 
-    void readDirectoryEntriesFromBlock(uint32_t block, std::vector<ext2_dir_entry*> &entries) {
-        int blockSize = EXT2_BLOCK_SIZE(superBlock);
-        std::vector<char> buffer(blockSize);
-        fsReader.preadData(buffer.data(), blockSize, block * blockSize);
-
-        int offset = 0;
-        while (offset < blockSize) {
-            ext2_dir_entry *entry = reinterpret_cast<ext2_dir_entry *>(buffer.data() + offset);
-            if (entry->inode == 0 || entry->length == 0) break;
-            entries.push_back(entry);
-            offset += entry->length;
-
-            // Ensure entry length is a multiple of 4 to avoid misalignment issues
-            offset = (offset + 3) & ~3;
+    static std::string_view fileTypeName(uint16_t mode) {
+        switch (mode & 0xF000) {
+        case EXT2_I_DTYPE: return "directory";
+        case EXT2_I_FTYPE: return "file";
+        case EXT2_I_LTYPE: return "symlink";
+        default: return "other";
         }
     }
+};
 
-    void readIndirectBlocks(uint32_t block, int level, std::vector<ext2_dir_entry*> &entries) {
-        if (level < 1) return;
-
-        int blockSize = EXT2_BLOCK_SIZE(superBlock);
-        std::vector<uint32_t> blockPointers(blockSize / sizeof(uint32_t));
-        fsReader.preadData(blockPointers.data(), blockSize, block * blockSize);
-
-        for (uint32_t pointer : blockPointers) {
-            if (pointer == 0) continue;
-            if (level == 1) {
-                readDirectoryEntriesFromBlock(pointer, entries);
-            } else {
-                readIndirectBlocks(pointer, level - 1, entries);
+// Splits "--option value" pairs out of the identifier bytes. Returns false
+// on an unknown option, a missing value or a count that is not positive.
+// --jobs is capped at the hardware thread count and --queue-depth at
+// MAX_SCAN_QUEUE_DEPTH, with a warning when a value is reduced.
+bool parseOptions(int argc, char *argv[], RecoveryOptions &options, std::vector<char *> &args) {
+    args.assign(argv, argv + std::min(argc, 2));
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            args.push_back(argv[i]);
+            continue;
+        }
+        if (arg == "--update-counters") {
+            options.updateCounters = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        if (arg == "--tree-output") {
+            options.treeOutput = argv[++i];
+            continue;
+        }
+        if (arg == "--format") {
+            std::string format = argv[++i];
+            if (format != "text" && format != "ndjson") {
+                return false;
             }
+            options.ndjson = format == "ndjson";
+            continue;
+        }
+        // strtoul would wrap a leading '-' around, so only digits are taken.
+        const char *text = argv[++i];
+        char *end;
+        unsigned long value = strtoul(text, &end, 10);
+        if (!isdigit(static_cast<unsigned char>(text[0])) || *end != '\0' || value == 0) {
+            return false;
+        }
+        unsigned long limit;
+        if (arg == "--queue-depth") {
+            limit = MAX_SCAN_QUEUE_DEPTH;
+            options.queueDepth = std::min(value, limit);
+        } else if (arg == "--jobs") {
+            limit = std::max(std::thread::hardware_concurrency(), 1u);
+            options.jobs = std::min(value, limit);
+        } else {
+            return false;
+        }
+        if (value > limit) {
+            std::cerr << "Warning: " << arg << " " << text << " is above the limit of " << limit << "; using " << limit
+                      << std::endl;
         }
     }
-};
-
+    return true;
+}
 
 int main(int argc, char *argv[]) {
-    if (argc < 3) {
-        std::cerr << "Usage: " << argv[0] << " <image_location> <data_identifier>" << std::endl;
+    RecoveryOptions options;
+    std::vector<char *> args;
+    if (argc < 3 || !parseOptions(argc, argv, options, args)) {
+        std::cerr << "Usage: " << argv[0] << " <image_location> <data_identifier> [--format text|ndjson] [--jobs N] [--queue-depth N] [--tree-output FILE] [--update-counters]" << std::endl;
         return EXIT_FAILURE;
     }
-    std::string imagePath = argv[1];
-    uint8_t* rawIdentifier = parse_identifier(argc, argv);
-    std::vector<uint8_t> dataIdentifier(rawIdentifier, rawIdentifier + (argc - 2));
+    std::string imagePath = args[1];
+    uint8_t* rawIdentifier = parse_identifier(args.size(), args.data());
+    std::vector<uint8_t> dataIdentifier(rawIdentifier, rawIdentifier + (args.size() - 2));
     delete[] rawIdentifier;
 
     try {
-        Ext2Recovery recovery(imagePath, dataIdentifier);
-        recovery.recover();
+        int outputFd = STDOUT_FILENO;
+        if (!options.treeOutput.empty()) {
+            outputFd = open(options.treeOutput.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (outputFd == -1) {
+                throw std::runtime_error("Failed to open tree output file");
+            }
+        }
+        {
+            OutputWriter output(outputFd);
+            NdjsonWriter json(output);
+            NdjsonWriter *report = options.ndjson ? &json : nullptr;
+
+            Ext2Recovery recovery(imagePath, dataIdentifier, options, report);
+            recovery.recover();
 
-        DirectoryTraversal dirTraversal(recovery.getFileSystemReader());
-        dirTraversal.printDirectoryTree();
+            DirectoryTraversal dirTraversal(recovery.getFileSystemReader(), output, report);
+            dirTraversal.printDirectoryTree();
+        }
+        if (outputFd != STDOUT_FILENO) {
+            close(outputFd);
+        }
     } catch (const std::exception &ex) {
         std::cerr << "Error: " << ex.what() << std::endl;
         return EXIT_FAILURE;
@@ -0,0 +1,90 @@
+#!/bin/bash
+# Recovers a sparse 6 GiB image whose files, inode tables and bitmaps sit
+# past the 4 GiB mark, then small images whose last block group is partial.
+# Needs mke2fs, debugfs and e2fsck (e2fsprogs).
+set -e
+
+IMG=${1:-/tmp/recext2fs-large.img}
+ID="01 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00"
+BLOCK_SIZE=4096
+LOW_BLOCKS=1100000      # 4.2 GiB of 4K blocks kept busy while populating
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+make
+
+rm -f "$IMG"
+truncate -s 6G "$IMG"
+mke2fs -q -F -t ext2 -b $BLOCK_SIZE -N 65536 "$IMG"
+IPG=$(dumpe2fs -h "$IMG" 2>/dev/null | awk -F: '/^Inodes per group/ {print $2 + 0}')
+
+# Every data block starts with the identifier; the rest is filler.
+for i in 1 2 3; do
+    for block in $(seq 40); do
+        printf '\x01'; head -c 31 /dev/zero; head -c $((BLOCK_SIZE - 32)) /dev/urandom
+    done > "$WORK/file$i"
+done
+
+# Occupy the low blocks and inodes so everything new lands above 4 GiB,
+# then give them back.
+debugfs -w "$IMG" > /dev/null 2>&1 <<EOF
+setb 1 $LOW_BLOCKS
+seti <12> $((IPG * 40))
+mkdir dir
+write $WORK/file1 dir/file1
+write $WORK/file2 dir/file2
+mkdir dir/sub
+write $WORK/file3 dir/sub/file3
+freeb 1 $LOW_BLOCKS
+freei <12> $((IPG * 40))
+EOF
+# freeb also cleared the low groups' metadata bits; let e2fsck put them back.
+e2fsck -fy "$IMG" > /dev/null || true
+e2fsck -fn "$IMG" > /dev/null
+
+FIRST=$(debugfs -R "bmap dir/file1 0" "$IMG" 2>/dev/null)
+INODE=$(debugfs -R "stat dir/file1" "$IMG" 2>/dev/null | awk '/^Inode:/ {print $2}')
+if [ "$FIRST" -lt $LOW_BLOCKS ] || [ "$INODE" -le $((IPG * 40)) ]; then
+    echo "file1 did not land above 4 GiB (block $FIRST, inode $INODE)"
+    exit 1
+fi
+debugfs -R "ls -l dir" "$IMG" 2>/dev/null > "$WORK/before.txt"
+
+# Damage: every bitmap bit cleared (the inode bitmap padding stays set) and
+# a direct pointer lost.
+clear_bitmaps() {
+    local image=$1 block_size=$2 ipg
+    ipg=$(dumpe2fs -h "$image" 2>/dev/null | awk -F: '/^Inodes per group/ {print $2 + 0}')
+    dumpe2fs "$image" 2>/dev/null | awk '/(Block|Inode) bitmap at/ {print $1, $4}' | while read -r kind bitmap; do
+        bytes=$block_size
+        [ "$kind" = Inode ] && bytes=$(((ipg + 7) / 8))
+        dd if=/dev/zero of="$image" bs=1 seek=$((bitmap * block_size)) count=$bytes conv=notrunc status=none
+    done
+}
+clear_bitmaps "$IMG" $BLOCK_SIZE
+debugfs -w -R "sif dir/file2 block[3] 0" "$IMG" > /dev/null 2>&1
+
+./recext2fs "$IMG" $ID --update-counters
+
+debugfs -R "ls -l dir" "$IMG" 2>/dev/null | diff "$WORK/before.txt" -
+debugfs -R "cat dir/file2" "$IMG" 2>/dev/null | cmp - "$WORK/file2"
+e2fsck -fn "$IMG"
+echo "large image recovered"
+
+# The block bitmap of a partial last group keeps its padding bits set.
+for geometry in 1024:20000 2048:20000 4096:40000; do
+    block_size=${geometry%%:*}
+    blocks=${geometry##*:}
+    small="$WORK/partial.img"
+    rm -f "$small"
+    truncate -s $((block_size * blocks)) "$small"
+    mke2fs -q -F -t ext2 -b $block_size "$small" $blocks
+    debugfs -w "$small" > /dev/null 2>&1 <<EOF
+mkdir dir
+write $WORK/file1 dir/file1
+EOF
+    clear_bitmaps "$small" $block_size
+    ./recext2fs "$small" $ID --update-counters > /dev/null
+    e2fsck -fn "$small" > /dev/null
+done
+echo "partial last groups recovered"
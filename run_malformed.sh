@@ -0,0 +1,59 @@
+#!/bin/bash
+# Runs recext2fs over a small image with a hand-damaged directory block and
+# checks the tree output only lists the entries that are intact, that the
+# NDJSON output stays valid for a name that is not UTF-8, and that a
+# directory block cut off by truncating the image reads as empty.
+set -e
+
+IMG=${1:-/tmp/recext2fs-malformed.img}
+ID="01 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00"
+BLOCK_SIZE=4096
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+make
+
+rm -f "$IMG"
+truncate -s 8M "$IMG"
+mke2fs -q -F -t ext2 -b $BLOCK_SIZE "$IMG"
+{ printf '\x01'; head -c $((BLOCK_SIZE - 1)) /dev/zero; } > "$WORK/file"
+debugfs -w "$IMG" > /dev/null 2>&1 <<EOF
+mkdir dir
+write $WORK/file dir/file
+EOF
+
+DIR_BLOCK=$(debugfs -R "bmap dir 0" "$IMG" 2>/dev/null)
+DIR_INODE=$(debugfs -R "stat dir" "$IMG" 2>/dev/null | awk '/^Inode:/ {print $2}')
+FILE_INODE=$(debugfs -R "stat dir/file" "$IMG" 2>/dev/null | awk '/^Inode:/ {print $2}')
+
+# ".", ".." and "f\xffle", then a record whose rec_len (4) is shorter than its
+# header and whose name_len (255) runs past the end of the record.
+python3 - "$IMG" $((DIR_BLOCK * BLOCK_SIZE)) "$DIR_INODE" "$FILE_INODE" <<'EOF'
+import struct, sys
+image, offset, dir_inode, file_inode = sys.argv[1], int(sys.argv[2]), int(sys.argv[3]), int(sys.argv[4])
+block = struct.pack('<IHBB4s', dir_inode, 12, 1, 2, b'.')
+block += struct.pack('<IHBB4s', 2, 12, 2, 2, b'..')
+block += struct.pack('<IHBB4s', file_inode, 1016 - 24, 4, 1, b'f\xffle').ljust(1016 - 24, b'\0')
+block += struct.pack('<IHBB', file_inode, 4, 255, 1)
+with open(image, 'r+b') as f:
+    f.seek(offset)
+    f.write(block)
+EOF
+
+./recext2fs "$IMG" $ID --tree-output "$WORK/tree.txt" > /dev/null
+printf -- '- lost+found/\n- dir/\n-- f\xffle\n' | diff - "$WORK/tree.txt"
+
+./recext2fs "$IMG" $ID --format ndjson > "$WORK/report.ndjson"
+python3 - "$WORK/report.ndjson" <<'EOF'
+import json, sys
+with open(sys.argv[1], 'rb') as f:
+    records = [json.loads(line.decode('ascii')) for line in f]
+paths = [r['path'].encode('latin-1') for r in records if r['record'] == 'entry']
+assert paths == [b'/lost+found', b'/dir', b'/dir/f\xffle'], paths
+EOF
+
+# Cut the image off just before the directory block.
+truncate -s $((DIR_BLOCK * BLOCK_SIZE)) "$IMG"
+./recext2fs "$IMG" $ID --tree-output "$WORK/tree.txt" > /dev/null
+printf -- '- lost+found/\n- dir/\n' | diff - "$WORK/tree.txt"
+echo "malformed entries skipped"
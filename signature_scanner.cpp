@@ -0,0 +1,151 @@
+#include "signature_scanner.h"
+#include <algorithm>
+#include <cstring>
+#include "cpu_dispatch.h"
+
+#ifdef HAVE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+// The vector kernels compare up to this many leading bytes at once.
+#define SIGNATURE_PREFIX_LIMIT 64
+
+static bool prefixMatchesScalar(const void *data, const uint8_t *prefix, size_t length) {
+    return memcmp(data, prefix, length) == 0;
+}
+
+#ifdef HAVE_X86_DISPATCH
+
+// Each kernel loads the first 64 bytes of the block, so it is only used
+// when at least that many are available. prefix is padded to 64 bytes.
+
+static uint64_t prefixMask(size_t length) {
+    return length >= 64 ? ~uint64_t(0) : (uint64_t(1) << length) - 1;
+}
+
+__attribute__((target("sse2")))
+static bool prefixMatchesSse2(const void *data, const uint8_t *prefix, size_t length) {
+    const char *bytes = static_cast<const char *>(data);
+    uint64_t equal = 0;
+    for (int i = 0; i < 4; ++i) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + 16 * i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(prefix + 16 * i));
+        equal |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)))) << (16 * i);
+    }
+    uint64_t mask = prefixMask(length);
+    return (equal & mask) == mask;
+}
+
+__attribute__((target("avx2")))
+static bool prefixMatchesAvx2(const void *data, const uint8_t *prefix, size_t length) {
+    const char *bytes = static_cast<const char *>(data);
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes + 32));
+    __m256i pa = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(prefix));
+    __m256i pb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(prefix + 32));
+    uint64_t equal = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, pa))) |
+                     static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, pb)))) << 32;
+    uint64_t mask = prefixMask(length);
+    return (equal & mask) == mask;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static bool prefixMatchesAvx512(const void *data, const uint8_t *prefix, size_t length) {
+    __m512i a = _mm512_loadu_si512(data);
+    __m512i b = _mm512_loadu_si512(prefix);
+    return _mm512_mask_cmpneq_epi8_mask(prefixMask(length), a, b) == 0;
+}
+
+#endif
+
+typedef bool (*PrefixMatchFunction)(const void *, const uint8_t *, size_t);
+
+static const CpuKernel<PrefixMatchFunction> prefixMatchKernels[] = {
+#ifdef HAVE_X86_DISPATCH
+    {CPU_AVX512BW, prefixMatchesAvx512, "avx512"},
+    {CPU_AVX2, prefixMatchesAvx2, "avx2"},
+    {CPU_SSE2, prefixMatchesSse2, "sse2"},
+#endif
+    {CPU_PORTABLE, prefixMatchesScalar, "scalar"},
+};
+
+static const CpuKernel<PrefixMatchFunction> &prefixMatchKernel = selectCpuKernel(prefixMatchKernels);
+
+SignatureScanner::SignatureScanner(const std::vector<std::vector<uint8_t>> &signatures)
+    : nodes(1) {
+    bool first = true;
+    for (size_t id = 0; id < signatures.size(); ++id) {
+        const std::vector<uint8_t> &signature = signatures[id];
+        if (signature.empty()) {
+            continue;
+        }
+
+        int32_t node = 0;
+        for (uint8_t byte : signature) {
+            int32_t next = child(node, byte);
+            if (next == 0) {
+                next = static_cast<int32_t>(nodes.size());
+                std::vector<Edge> &edges = nodes[node].edges;
+                auto position = std::lower_bound(edges.begin(), edges.end(), byte,
+                                                 [](const Edge &edge, uint8_t value) { return edge.byte < value; });
+                edges.insert(position, {byte, next});
+                nodes.emplace_back();
+            }
+            node = next;
+        }
+        if (nodes[node].signature == NO_MATCH) {
+            nodes[node].signature = static_cast<int>(id);
+        }
+
+        if (first) {
+            prefix = signature;
+            first = false;
+        } else {
+            size_t shared = std::mismatch(prefix.begin(), prefix.end(), signature.begin(), signature.end()).first - prefix.begin();
+            prefix.resize(shared);
+        }
+    }
+
+    // No signature ends inside the common prefix, so the trie walk can
+    // start right after it.
+    prefixLength = std::min<size_t>(prefix.size(), SIGNATURE_PREFIX_LIMIT);
+    prefixNode = 0;
+    for (size_t i = 0; i < prefixLength; ++i) {
+        prefixNode = child(prefixNode, prefix[i]);
+    }
+    prefix.resize(SIGNATURE_PREFIX_LIMIT, 0);
+}
+
+int SignatureScanner::match(const void *data, size_t size) const {
+    if (nodes.size() == 1 || size < prefixLength) {
+        return NO_MATCH;
+    }
+    if (prefixLength > 0) {
+        bool matches = size >= SIGNATURE_PREFIX_LIMIT ? prefixMatchKernel.function(data, prefix.data(), prefixLength)
+                                                      : prefixMatchesScalar(data, prefix.data(), prefixLength);
+        if (!matches) {
+            return NO_MATCH;
+        }
+    }
+
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    int32_t node = prefixNode;
+    int signature = nodes[node].signature;
+    for (size_t i = prefixLength; i < size && !nodes[node].edges.empty(); ++i) {
+        node = child(node, bytes[i]);
+        if (node == 0) {
+            break;
+        }
+        if (nodes[node].signature != NO_MATCH) {
+            signature = nodes[node].signature;
+        }
+    }
+    return signature;
+}
+
+int32_t SignatureScanner::child(int32_t node, uint8_t byte) const {
+    const std::vector<Edge> &edges = nodes[node].edges;
+    auto position = std::lower_bound(edges.begin(), edges.end(), byte,
+                                     [](const Edge &edge, uint8_t value) { return edge.byte < value; });
+    return position != edges.end() && position->byte == byte ? position->node : 0;
+}
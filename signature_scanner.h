@@ -0,0 +1,45 @@
+#ifndef SIGNATURE_SCANNER_H
+#define SIGNATURE_SCANNER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Classifies blocks by the signature they start with. All signatures are
+// first checked together against their common prefix with one masked
+// vector compare (AVX-512, AVX2 or SSE2, whichever the CPU has); blocks
+// that pass are resolved by a trie over the remaining bytes, so a set of
+// signatures costs one pass over each block's first bytes.
+class SignatureScanner {
+public:
+    static const int NO_MATCH = -1;
+
+    // Empty signatures never match.
+    explicit SignatureScanner(const std::vector<std::vector<uint8_t>> &signatures);
+
+    // Index of the longest signature the size bytes at data start with, or
+    // NO_MATCH.
+    int match(const void *data, size_t size) const;
+
+private:
+    struct Edge {
+        uint8_t byte;
+        int32_t node;
+    };
+
+    struct Node {
+        std::vector<Edge> edges; // sorted by byte
+        int signature = NO_MATCH;
+    };
+
+    std::vector<Node> nodes;
+    // Bytes shared by every signature (zero-padded for the vector compare),
+    // and the trie node reached after them.
+    std::vector<uint8_t> prefix;
+    size_t prefixLength = 0;
+    int32_t prefixNode = 0;
+
+    int32_t child(int32_t node, uint8_t byte) const;
+};
+
+#endif // !SIGNATURE_SCANNER_H
@@ -0,0 +1,84 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned jobs)
+    : jobCount(std::max(jobs, 1u)) {
+    // Worker 0 is the calling thread.
+    for (unsigned worker = 1; worker < jobCount; ++worker) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, worker);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeWorkers.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const Task &task) {
+    if (jobCount == 1) {
+        for (size_t index = 0; index < count; ++index) {
+            task(index, 0);
+        }
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    currentTask = &task;
+    taskCount = count;
+    nextIndex = 0;
+    failure = nullptr;
+    ++generation;
+    wakeWorkers.notify_all();
+
+    runItems(0, lock);
+    batchDone.wait(lock, [this] { return busyWorkers == 0 && nextIndex >= taskCount; });
+    currentTask = nullptr;
+
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+void ThreadPool::workerLoop(unsigned worker) {
+    unsigned long seenGeneration = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wakeWorkers.wait(lock, [&] { return stopping || generation != seenGeneration; });
+        if (stopping) {
+            return;
+        }
+        seenGeneration = generation;
+        runItems(worker, lock);
+    }
+}
+
+// Claims indices one at a time until the batch is exhausted. Called and
+// returns with the lock held; the task itself runs unlocked.
+void ThreadPool::runItems(unsigned worker, std::unique_lock<std::mutex> &lock) {
+    ++busyWorkers;
+    while (currentTask != nullptr && nextIndex < taskCount) {
+        size_t index = nextIndex++;
+        const Task &task = *currentTask;
+        lock.unlock();
+        try {
+            task(index, worker);
+        } catch (...) {
+            lock.lock();
+            if (!failure) {
+                failure = std::current_exception();
+            }
+            nextIndex = taskCount;
+            continue;
+        }
+        lock.lock();
+    }
+    if (--busyWorkers == 0) {
+        batchDone.notify_all();
+    }
+}
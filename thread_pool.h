@@ -0,0 +1,50 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for splitting recovery work by block group.
+// A pool of one job runs everything on the calling thread.
+class ThreadPool {
+public:
+    // Runs for one item; worker is in [0, size()) and identifies the
+    // thread, so callers can keep per-worker partial results.
+    using Task = std::function<void(size_t index, unsigned worker)>;
+
+    explicit ThreadPool(unsigned jobs);
+    ~ThreadPool();
+
+    unsigned size() const {
+        return jobCount;
+    }
+
+    // Runs task for every index in [0, count) and waits for all of them.
+    // The first exception thrown by a task is rethrown here.
+    void parallelFor(size_t count, const Task &task);
+
+private:
+    unsigned jobCount;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wakeWorkers;
+    std::condition_variable batchDone;
+
+    const Task *currentTask = nullptr;
+    size_t taskCount = 0;
+    size_t nextIndex = 0;
+    unsigned busyWorkers = 0;
+    unsigned long generation = 0;
+    bool stopping = false;
+    std::exception_ptr failure;
+
+    void workerLoop(unsigned worker);
+    void runItems(unsigned worker, std::unique_lock<std::mutex> &lock);
+};
+
+#endif // !THREAD_POOL_H
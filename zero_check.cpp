@@ -0,0 +1,105 @@
+#include "zero_check.h"
+#include <stdint.h>
+#include <cstring>
+#include "cpu_dispatch.h"
+
+#ifdef HAVE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+bool isZeroBlockScalar(const void *data, size_t size) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    size_t i = 0;
+    for (; i + 4 * sizeof(uint64_t) <= size; i += 4 * sizeof(uint64_t)) {
+        uint64_t words[4];
+        memcpy(words, bytes + i, sizeof(words));
+        if ((words[0] | words[1] | words[2] | words[3]) != 0) {
+            return false;
+        }
+    }
+    for (; i < size; ++i) {
+        if (bytes[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef HAVE_X86_DISPATCH
+
+// Each kernel ORs four vectors per iteration and tests the result, so it
+// leaves after the first 64/128/256-byte group containing a set bit.
+
+__attribute__((target("sse2")))
+static bool isZeroBlockSse2(const void *data, size_t size) {
+    const char *bytes = static_cast<const char *>(data);
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i + 48));
+        __m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, _mm_setzero_si128())) != 0xFFFF) {
+            return false;
+        }
+    }
+    return isZeroBlockScalar(bytes + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static bool isZeroBlockAvx2(const void *data, size_t size) {
+    const char *bytes = static_cast<const char *>(data);
+    size_t i = 0;
+    for (; i + 128 <= size; i += 128) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes + i + 32));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes + i + 64));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes + i + 96));
+        __m256i any = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+        if (!_mm256_testz_si256(any, any)) {
+            return false;
+        }
+    }
+    return isZeroBlockScalar(bytes + i, size - i);
+}
+
+__attribute__((target("avx512f")))
+static bool isZeroBlockAvx512(const void *data, size_t size) {
+    const char *bytes = static_cast<const char *>(data);
+    size_t i = 0;
+    for (; i + 256 <= size; i += 256) {
+        __m512i a = _mm512_loadu_si512(bytes + i);
+        __m512i b = _mm512_loadu_si512(bytes + i + 64);
+        __m512i c = _mm512_loadu_si512(bytes + i + 128);
+        __m512i d = _mm512_loadu_si512(bytes + i + 192);
+        __m512i any = _mm512_or_si512(_mm512_or_si512(a, b), _mm512_or_si512(c, d));
+        if (_mm512_test_epi64_mask(any, any) != 0) {
+            return false;
+        }
+    }
+    return isZeroBlockScalar(bytes + i, size - i);
+}
+
+#endif
+
+typedef bool (*ZeroCheckFunction)(const void *, size_t);
+
+static const CpuKernel<ZeroCheckFunction> zeroCheckKernels[] = {
+#ifdef HAVE_X86_DISPATCH
+    {CPU_AVX512F, isZeroBlockAvx512, "avx512"},
+    {CPU_AVX2, isZeroBlockAvx2, "avx2"},
+    {CPU_SSE2, isZeroBlockSse2, "sse2"},
+#endif
+    {CPU_PORTABLE, isZeroBlockScalar, "scalar"},
+};
+
+static const CpuKernel<ZeroCheckFunction> &zeroCheckKernel = selectCpuKernel(zeroCheckKernels);
+
+bool isZeroBlock(const void *data, size_t size) {
+    return zeroCheckKernel.function(data, size);
+}
+
+const char *zeroCheckImplementation() {
+    return zeroCheckKernel.name;
+}
@@ -0,0 +1,17 @@
+#ifndef ZERO_CHECK_H
+#define ZERO_CHECK_H
+
+#include <stddef.h>
+
+// Returns true if all size bytes at data are zero. Uses the widest of
+// AVX-512, AVX2 and SSE2 the CPU supports and stops at the first non-zero
+// vector group.
+bool isZeroBlock(const void *data, size_t size);
+
+// Portable 64-bit-word implementation used when no vector unit is available.
+bool isZeroBlockScalar(const void *data, size_t size);
+
+// Name of the implementation isZeroBlock dispatches to.
+const char *zeroCheckImplementation();
+
+#endif // !ZERO_CHECK_H